@@ -13,9 +13,12 @@
  * limitations under the License. */
 
 #include <QtCore/QDebug>
+#include <QtCore/QDir>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QTextStream>
 #include <QtCore/QThread>
+#include <QtCore/QVector>
 
 #include <trikKernel/fileUtils.h>
 #include <trikScriptRunner/trikScriptRunner.h>
@@ -26,15 +29,78 @@
 
 using namespace trikCommunicator;
 
+/// Size of a block in which files are read when hashing.
+int const hashBlockSize = 64 * 1024;
+
+/// Size of SHA-1 hash in bytes.
+int const sha1Size = 20;
+
+/// Returns lookup table for CRC-32 computation.
+static QVector<quint32> crc32Table()
+{
+	QVector<quint32> table(256);
+	for (quint32 i = 0; i < 256; ++i) {
+		quint32 value = i;
+		for (int bit = 0; bit < 8; ++bit) {
+			value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+		}
+
+		table[i] = value;
+	}
+
+	return table;
+}
+
+/// Computes CRC-32 of given data, the same as zlib's crc32().
+static quint32 crc32(char const *data, int size)
+{
+	// Initialization of a local static is thread-safe, connections compute checksums in threads of a pool.
+	static QVector<quint32> const table = crc32Table();
+
+	quint32 crc = 0xFFFFFFFFu;
+	for (int i = 0; i < size; ++i) {
+		crc = table[(crc ^ static_cast<uchar>(data[i])) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+/// Adds contents of a given file to a hash, returns false if file can not be read.
+static bool addFileToHash(QString const &filePath, QCryptographicHash &hash)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	while (!file.atEnd()) {
+		QByteArray const block = file.read(hashBlockSize);
+		if (block.isEmpty()) {
+			return false;
+		}
+
+		hash.addData(block);
+	}
+
+	return true;
+}
+
 Connection::Connection(trikScriptRunner::TrikScriptRunner &trikScriptRunner)
 	: trikKernel::Connection(trikKernel::Protocol::messageLength)
 	, mTrikScriptRunner(trikScriptRunner)
+	, mReceivedHash(QCryptographicHash::Sha1)
 {
 }
 
 void Connection::processData(QByteArray const &data)
 {
-	QString command = QString::fromUtf8(data.data());
+	// Chunks carry raw file contents, so they are not decoded as text and not logged.
+	if (data.startsWith("chunk:")) {
+		processChunk(data);
+		return;
+	}
+
+	QString command = QString::fromUtf8(data.constData(), data.size());
 
 	if (!command.startsWith("keepalive")) {
 		// Discard "keepalive" output.
@@ -56,11 +122,14 @@ void Connection::processData(QByteArray const &data)
 		QString const fileName = command.left(separatorPosition);
 		QString const fileContents = command.mid(separatorPosition + 1);
 		trikKernel::FileUtils::writeToFile(fileName, fileContents, mTrikScriptRunner.scriptsDirPath());
+		mTrikScriptRunner.cacheScript(mTrikScriptRunner.scriptsDirPath() + "/" + fileName);
 		QMetaObject::invokeMethod(&mTrikScriptRunner, "brickBeep");
+	} else if (command.startsWith("upload:")) {
+		startUpload(command.mid(QString("upload:").length()));
 	} else if (command.startsWith("run:")) {
 		command.remove(0, QString("run:").length());
-		QString const fileContents = trikKernel::FileUtils::readFromFile(mTrikScriptRunner.scriptsDirPath() + "/" + command);
-		QMetaObject::invokeMethod(&mTrikScriptRunner, "run", Q_ARG(QString, fileContents), Q_ARG(QString, command));
+		QString const filePath = mTrikScriptRunner.scriptsDirPath() + "/" + command;
+		QMetaObject::invokeMethod(&mTrikScriptRunner, "runFile", Q_ARG(QString, filePath), Q_ARG(QString, command));
 	} else if (command == "stop") {
 		QMetaObject::invokeMethod(&mTrikScriptRunner, "abort");
 	} else if (command.startsWith("direct:")) {
@@ -72,3 +141,176 @@ void Connection::processData(QByteArray const &data)
 				, Q_ARG(QString, command));
 	}
 }
+
+void Connection::startUpload(QString const &parameters)
+{
+	QStringList const parts = parameters.split(':');
+	bool sizeOk = false;
+	qint64 const size = parts.size() >= 3 ? parts[0].toLongLong(&sizeOk) : 0;
+	QByteArray const hash = parts.size() >= 3 ? QByteArray::fromHex(parts[1].toLatin1()) : QByteArray();
+	QString const fileName = parts.mid(2).join(":");
+	if (!sizeOk || size < 0 || hash.size() != sha1Size || fileName.isEmpty()) {
+		qDebug() << "Malformed 'upload' command";
+		QLOG_ERROR() << "Malformed 'upload' command";
+
+		return;
+	}
+
+	mPartFile.close();
+	mUploadFileName = fileName;
+	mUploadSize = size;
+	mUploadHash = hash;
+	mReceivedHash.reset();
+
+	QDir const scriptsDir(mTrikScriptRunner.scriptsDirPath());
+	scriptsDir.mkpath(".");
+
+	// File with the same contents is already there, so there is nothing to upload.
+	QCryptographicHash existingHash(QCryptographicHash::Sha1);
+	QString const filePath = scriptsDir.filePath(fileName);
+	bool const isSameSize = QFileInfo(filePath).exists() && QFileInfo(filePath).size() == size;
+	if (isSameSize && addFileToHash(filePath, existingHash) && existingHash.result() == hash) {
+		QLOG_INFO() << "File" << fileName << "is not changed, upload skipped";
+		mUploadFileName.clear();
+		mTrikScriptRunner.cacheScript(filePath);
+		send(QString("uploaded:" + fileName).toUtf8());
+		QMetaObject::invokeMethod(&mTrikScriptRunner, "brickBeep");
+		return;
+	}
+
+	// Part file is kept near the target file, so file name may contain subdirectories that are created here.
+	QString const partPath = partFilePath(fileName, hash);
+	QFileInfo const targetInfo(filePath);
+	QDir const targetDir = targetInfo.dir();
+	targetDir.mkpath(".");
+
+	// Parts of other versions of this file will never be resumed.
+	QStringList const partFiles = targetDir.entryList(QStringList("." + targetInfo.fileName() + ".*.part")
+			, QDir::Hidden | QDir::Files);
+
+	for (QString const &stalePart : partFiles) {
+		if (targetDir.filePath(stalePart) != partPath) {
+			targetDir.remove(stalePart);
+		}
+	}
+
+	// Contents received before a connection was lost are kept, so an upload continues from where it stopped.
+	mPartFile.setFileName(partPath);
+	if (mPartFile.size() > size || !addFileToHash(partPath, mReceivedHash)) {
+		QFile::remove(partPath);
+		mReceivedHash.reset();
+	}
+
+	if (!mPartFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		qDebug() << "Failed to open file" << partPath << "for writing";
+		QLOG_ERROR() << "Failed to open file" << partPath << "for writing";
+		mUploadFileName.clear();
+		send(QString("error:can not write file:" + fileName).toUtf8());
+		return;
+	}
+
+	mReceivedSize = mPartFile.size();
+	if (mReceivedSize == size) {
+		finishUpload();
+	} else {
+		requestResume();
+	}
+}
+
+void Connection::processChunk(QByteArray const &data)
+{
+	int const prefixLength = QByteArray("chunk:").size();
+	int const offsetEnd = data.indexOf(':', prefixLength);
+	int const checksumEnd = offsetEnd == -1 ? -1 : data.indexOf(':', offsetEnd + 1);
+	if (checksumEnd == -1) {
+		qDebug() << "Malformed 'chunk' command";
+		QLOG_ERROR() << "Malformed 'chunk' command";
+
+		return;
+	}
+
+	if (mUploadFileName.isEmpty()) {
+		send("error:no upload in progress");
+		return;
+	}
+
+	bool offsetOk = false;
+	bool checksumOk = false;
+	qint64 const offset = data.mid(prefixLength, offsetEnd - prefixLength).toLongLong(&offsetOk);
+	quint32 const checksum = data.mid(offsetEnd + 1, checksumEnd - offsetEnd - 1).toUInt(&checksumOk, 16);
+	char const * const payload = data.constData() + checksumEnd + 1;
+	int const payloadSize = data.size() - checksumEnd - 1;
+
+	if (!offsetOk || !checksumOk || offset != mReceivedSize) {
+		// Chunks already sent by a client after a corrupted one are dropped until it resumes from the right place.
+		if (!mResumeRequested) {
+			requestResume();
+		}
+
+		return;
+	}
+
+	mResumeRequested = false;
+
+	if (crc32(payload, payloadSize) != checksum || offset + payloadSize > mUploadSize) {
+		QLOG_ERROR() << "Corrupted chunk of" << mUploadFileName << "at offset" << offset;
+		requestResume();
+		return;
+	}
+
+	if (mPartFile.write(payload, payloadSize) != payloadSize) {
+		qDebug() << "Failed to write file" << mPartFile.fileName() << ":" << mPartFile.errorString();
+		QLOG_ERROR() << "Failed to write file" << mPartFile.fileName() << ":" << mPartFile.errorString();
+		send(QString("error:can not write file:" + mUploadFileName).toUtf8());
+		mPartFile.close();
+		mUploadFileName.clear();
+		return;
+	}
+
+	mReceivedHash.addData(payload, payloadSize);
+	mReceivedSize += payloadSize;
+	if (mReceivedSize == mUploadSize) {
+		finishUpload();
+	}
+}
+
+void Connection::requestResume()
+{
+	mResumeRequested = true;
+	send(QString("resume:%1:%2").arg(mReceivedSize).arg(mUploadFileName).toUtf8());
+}
+
+void Connection::finishUpload()
+{
+	QString const fileName = mUploadFileName;
+	mUploadFileName.clear();
+	mPartFile.close();
+
+	if (mReceivedHash.result() != mUploadHash) {
+		QLOG_ERROR() << "Checksum mismatch for uploaded file" << fileName;
+		QFile::remove(mPartFile.fileName());
+		send(QString("error:checksum mismatch:" + fileName).toUtf8());
+		return;
+	}
+
+	QString const filePath = QDir(mTrikScriptRunner.scriptsDirPath()).filePath(fileName);
+	QFile::remove(filePath);
+	if (!QFile::rename(mPartFile.fileName(), filePath)) {
+		qDebug() << "Failed to move uploaded file to" << filePath;
+		QLOG_ERROR() << "Failed to move uploaded file to" << filePath;
+		send(QString("error:can not write file:" + fileName).toUtf8());
+		return;
+	}
+
+	QLOG_INFO() << "File" << fileName << "uploaded," << mUploadSize << "bytes";
+	mTrikScriptRunner.cacheScript(filePath);
+	send(QString("uploaded:" + fileName).toUtf8());
+	QMetaObject::invokeMethod(&mTrikScriptRunner, "brickBeep");
+}
+
+QString Connection::partFilePath(QString const &fileName, QByteArray const &hash) const
+{
+	// Leading dot is added to a base name, so a part file is hidden in the same directory as the target file.
+	QFileInfo const targetInfo(QDir(mTrikScriptRunner.scriptsDirPath()).filePath(fileName));
+	return targetInfo.dir().filePath("." + targetInfo.fileName() + "." + hash.toHex() + ".part");
+}
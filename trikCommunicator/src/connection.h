@@ -16,6 +16,8 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QFile>
+#include <QtCore/QCryptographicHash>
 #include <QtNetwork/QTcpSocket>
 #include <trikKernel/connection.h>
 
@@ -30,6 +32,15 @@ namespace trikCommunicator {
 ///
 /// Connection accepts commands:
 /// - file:<file name>:<file contents> --- save given contents to a file with given name in current directory.
+/// - upload:<size>:<sha1 hex>:<file name> --- start chunked upload of a file with given size and SHA-1 hash.
+///   Answers "uploaded:<file name>" if file with the same contents already exists, so nothing needs to be sent,
+///   or "resume:<offset>:<file name>" with offset from which chunks shall be sent (not zero if previous upload of
+///   the same contents was interrupted).
+/// - chunk:<offset>:<crc32 hex>:<raw data> --- next piece of a file being uploaded, data is written to disk as is.
+///   Chunks are not acknowledged, so a client may stream them one after another (pieces of 64 Kb are a good
+///   choice). Chunk with wrong offset or CRC-32 (as in zlib) is dropped and answered with "resume:<offset>:<file
+///   name>". When all data is received, SHA-1 is checked and "uploaded:<file name>" or
+///   "error:checksum mismatch:<file name>" is sent.
 /// - run:<file name> --- execute a file with given name.
 /// - stop --- stop current script execution and a robot.
 /// - direct:<command> --- execute given script without saving it to a file.
@@ -48,8 +59,42 @@ public:
 private:
 	void processData(QByteArray const &data) override;
 
+	/// Handles "upload" command, parameters are "<size>:<sha1 hex>:<file name>".
+	void startUpload(QString const &parameters);
+
+	/// Handles "chunk" command, data is the whole message.
+	void processChunk(QByteArray const &data);
+
+	/// Sends "resume" answer with current upload position.
+	void requestResume();
+
+	/// Checks hash of uploaded file and moves it to its place.
+	void finishUpload();
+
+	/// Returns path to a file with partially uploaded contents with given hash.
+	QString partFilePath(QString const &fileName, QByteArray const &hash) const;
+
 	/// Common script runner object, located in another thread.
 	trikScriptRunner::TrikScriptRunner &mTrikScriptRunner;
+
+	/// Name of a file being uploaded, empty if there is no upload in progress.
+	QString mUploadFileName;
+
+	/// Expected size and SHA-1 hash of a file being uploaded.
+	qint64 mUploadSize = 0;
+	QByteArray mUploadHash;
+
+	/// File with already received part of contents, opened for appending.
+	QFile mPartFile;
+
+	/// Number of already received bytes.
+	qint64 mReceivedSize = 0;
+
+	/// True if "resume" was sent and a client has not yet sent a chunk from requested position.
+	bool mResumeRequested = false;
+
+	/// Hash of already received part of contents.
+	QCryptographicHash mReceivedHash;
 };
 
 }
@@ -44,6 +44,8 @@ public:
 			, int normalizedValue1
 			, int normalizedValue2);
 
+	int valueFromRaw(int rawValue) const override;
+
 public slots:
 	/// Returns current reading of a sensor.
 	int read();
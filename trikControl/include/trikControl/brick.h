@@ -45,6 +45,7 @@
 namespace trikControl {
 
 class Configurer;
+class FlightRecorder;
 class I2cCommunicator;
 class PowerMotor;
 class ServoMotor;
@@ -73,6 +74,10 @@ public:
 	/// If it is false, script will exit immediately.
 	bool isInEventDrivenMode() const;
 
+	/// Returns time in milliseconds an aborted script is given to stop before motors are powered off forcibly, as
+	/// configured in config.xml.
+	int abortDeadline() const;
+
 public slots:
 	/// Plays given music file on a speaker (in format accepted by aplay utility).
 	void playSound(QString const &soundFileName);
@@ -149,6 +154,10 @@ public slots:
 	/// Returns reference to mailbox used to send and receive messages to/from other robots.
 	Mailbox *mailbox();
 
+	/// Returns contents of flight recorder (history of sensor readings and motor powers, see FlightRecorder for
+	/// format description), or empty array if flight recorder is disabled.
+	QByteArray flightRecord();
+
 	/// Starts event loop for script.
 	void run();
 
@@ -188,6 +197,7 @@ private:
 	Display mDisplay;
 	Led *mLed = nullptr;  // Has ownership.
 	QScopedPointer<Mailbox> mMailbox;
+	FlightRecorder *mFlightRecorder = nullptr;  // Has ownership.
 
 	/// True, if a system is in event-driven running mode, so it shall wait for events when script is executed.
 	/// If it is false, script will exit immediately.
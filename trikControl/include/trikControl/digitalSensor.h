@@ -17,6 +17,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
 #include <QtCore/QTextStream>
 
 #include "declSpec.h"
@@ -24,7 +25,7 @@
 
 namespace trikControl {
 
-/// Generic TRIK sensor.
+/// Generic TRIK sensor. Can be read from different threads (for example, by a script and by flight recorder).
 class TRIKCONTROL_EXPORT DigitalSensor : public Sensor
 {
 	Q_OBJECT
@@ -36,6 +37,8 @@ public:
 	/// @param deviceFile - device file for this sensor.
 	DigitalSensor(int min, int max, QString const &deviceFile);
 
+	int valueFromRaw(int rawValue) const override;
+
 public slots:
 	/// Returns current raw reading of a sensor.
 	int read();
@@ -48,6 +51,9 @@ private:
 	int mMax;
 	QFile mDeviceFile;
 	QTextStream mStream;
+
+	/// Guards mDeviceFile and mStream, which are reused by every read.
+	QMutex mMutex;
 };
 
 }
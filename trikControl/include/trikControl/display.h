@@ -16,6 +16,9 @@
 
 #include <QtCore/QThread>
 #include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
 
 #include "declSpec.h"
 
@@ -36,6 +39,30 @@ public:
 
 	~Display();
 
+	/// Shows raw pixel buffer on a display. Pixels are not copied, image is drawn directly from given byte array,
+	/// which is implicitly shared, so caller may continue to use and modify its own copy (it will detach then).
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	/// @param format - pixel format of a buffer. Lines shall be 32-bit aligned, as QImage requires.
+	/// @param data - pixel data.
+	void drawBuffer(int width, int height, QImage::Format format, QByteArray const &data);
+
+	/// Shows a frame from shared memory segment with given key, for example, processed camera frame published by
+	/// other process. Segment is attached on first use and then is kept attached, so it is cheap to call this method
+	/// at video rate. Segment is locked while its contents is painted.
+	/// @param key - key of QSharedMemory segment.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	/// @param format - pixel format of a segment contents. Lines shall be 32-bit aligned, as QImage requires.
+	void drawSharedBuffer(QString const &key, int width, int height, QImage::Format format);
+
+	/// Starts streaming display contents to a TCP client for remote debugging. Only changed parts of a display are
+	/// sent, compressed, and no more often than given frame rate cap.
+	/// @param port - TCP port to listen for clients.
+	/// @param maxFps - maximal number of frames per second to send.
+	/// @param tileSize - size of a side of a tile in pixels, display is compared with previous frame tile by tile.
+	void startMirroring(int port, int maxFps, int tileSize);
+
 public slots:
 	/// Shows given image on a display.
 	/// @param fileName - file name (with path) of an image to show. Refer to Qt documentation for
@@ -109,6 +136,18 @@ public slots:
 	/// Clear everything painted with this object.
 	void clear();
 
+	/// Shows array of pixels on a display without copying it.
+	/// @param pixels - pixels in 0xRRGGBB format, line by line.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	void drawBuffer(QVector<int> const &pixels, int width, int height);
+
+	/// Shows a frame in 0xRRGGBB format from shared memory segment with given key.
+	/// @param key - key of QSharedMemory segment.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	void drawSharedBuffer(QString const &key, int width, int height);
+
 private:
 	QThread &mGuiThread;
 	QString const mStartDirPath;
@@ -34,6 +34,10 @@ public:
 	/// @param rawToDegrees - coefficient for converting raw encoder readings to degrees.
 	Encoder(I2cCommunicator &communicator, int i2cCommandNumber, double rawToDegrees);
 
+	/// Converts raw reading of encoder, as returned by readRawData(), to degrees, as returned by read(). Allows to get
+	/// both values by one hardware read.
+	int valueFromRaw(int rawValue) const;
+
 public slots:
 	/// Returns current encoder reading (in degrees).
 	int read();
@@ -18,25 +18,29 @@
 #include <QtCore/QScopedPointer>
 #include <QtCore/QThread>
 #include <QtCore/QHash>
-#include <QtCore/QSet>
+#include <QtCore/QMutex>
 
 #include "declSpec.h"
 
 namespace trikControl {
 
-class TcpConnector;
-
-/// Class to support remote control of a robot using TCP client.
+/// Class to support remote control of a robot using TCP or UDP client. Any number of clients may send commands
+/// at once, events are processed in order of arrival. Gamepad state is updated in a thread that owns Gamepad object
+/// and is read from script thread, so all access to it is synchronized. Every event is stamped with time of its
+/// arrival to a socket, so latency from network to a script is measured when a script first sees an event.
 class TRIKCONTROL_EXPORT Gamepad : public QObject
 {
 	Q_OBJECT
 
 public:
 	/// Constructor.
-	/// @param port - TCP port of a gamepad server.
-	Gamepad(int port);
+	/// @param port - TCP or UDP port of a gamepad server.
+	/// @param useUdp - if true, commands are received as UDP datagrams, otherwise via TCP connections.
+	/// @param legacyFraming - if true, TCP commands are not separated by newline, every read is a command. For old
+	///        clients only.
+	Gamepad(int port, bool useUdp = false, bool legacyFraming = false);
 
-	/// Destructor declared here for QScopedPointer to be able to clean up forward-declared TcpConnector.
+	/// Stops network thread.
 	virtual ~Gamepad();
 
 public slots:
@@ -55,6 +59,16 @@ public slots:
 	/// Returns current Y coordinate of given pad or -1 if this pad is not pressed.
 	int padY(int pad);
 
+	/// Returns latency of the last event seen by a script, from its arrival to a socket to the moment when a script
+	/// read it, in microseconds.
+	int lastLatency();
+
+	/// Returns average latency of events seen by a script since last reset, in microseconds.
+	int averageLatency();
+
+	/// Returns maximal latency of events seen by a script since last reset, in microseconds.
+	int maxLatency();
+
 signals:
 	/// @todo ??!
 	void padUp(int pad);
@@ -63,7 +77,10 @@ signals:
 	void button(int button, int pressed);
 
 private slots:
-	void parse(QString const &message);
+	/// Parses a command and updates gamepad state.
+	/// @param message - command text.
+	/// @param receiveTime - trikKernel::MonotonicClock time in microseconds when a command was read from a socket.
+	void parse(QString const &message, qint64 receiveTime);
 
 private:
 	Q_DISABLE_COPY(Gamepad)
@@ -72,13 +89,36 @@ private:
 		int x;
 		int y;
 		bool isPressed;
+
+		/// Time when the last event for this pad was received.
+		qint64 receiveTime;
+
+		/// True if the last event for this pad was already seen by a script.
+		bool isSeen;
 	};
 
-	QScopedPointer<TcpConnector> mListener;
+	/// Accounts latency of an event being seen by a script for the first time. Shall be called with mStateLock held.
+	void registerSeen(qint64 receiveTime);
+
+	/// Returns pad status and marks its last event as seen, or nullptr if there were no events for this pad.
+	/// Shall be called with mStateLock held.
+	PadStatus const *seePad(int pad);
+
+	/// Network listener, TcpConnector or UdpConnector, lives in mNetworkThread.
+	QScopedPointer<QObject> mListener;
 	QThread mNetworkThread;
 
-	QSet<int> mButtonWasPressed;
+	/// Guards gamepad state and latency statistics.
+	QMutex mStateLock;
+
+	/// Maps button code to time of the last not yet consumed press of this button.
+	QHash<int, qint64> mButtonWasPressed;
 	QHash<int, PadStatus> mPads;
+
+	qint64 mLastLatency = 0;
+	qint64 mMaxLatency = 0;
+	qint64 mTotalLatency = 0;
+	int mSeenEvents = 0;
 };
 
 }
@@ -19,6 +19,8 @@
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutex>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVariant>
 #include <QtNetwork/QHostAddress>
 
 #include "declSpec.h"
@@ -43,7 +45,10 @@ class TRIKCONTROL_EXPORT Mailbox : public QObject
 public:
 	/// Constructor.
 	/// @param port - port for mailbox server.
-	Mailbox(int port);
+	/// @param multicastGroup - IPv4 multicast group used for robot discovery and broadcast messages, empty string
+	///        disables multicast.
+	/// @param multicastPort - UDP port for multicast datagrams.
+	Mailbox(int port, QString const &multicastGroup = QString(), int multicastPort = 0);
 
 	~Mailbox() override;
 
@@ -57,6 +62,28 @@ public:
 	QHostAddress myIp() const;
 
 public slots:
+	/// Limits memory used by incoming messages when a robot sends them faster than a script receives.
+	/// @param maxSize - maximal number of not received messages from one robot, 0 means unlimited.
+	/// @param backpressure - if true, reading from a robot with full queue is paused until a script receives half of
+	///        its messages, so the robot is slowed down by TCP flow control, otherwise oldest message is dropped.
+	void setQueueLimit(int maxSize, bool backpressure);
+
+	/// Sets sending mode of links to other robots.
+	/// @param batchWindowMs - 0 for low latency mode, when every message is written to a network immediately with
+	///        Nagle's algorithm disabled; positive value for throughput mode, when messages sent within this number
+	///        of milliseconds are coalesced into one network write.
+	void setBatchWindow(int batchWindowMs);
+
+	/// Sets wire format of links to other robots. Binary framing has smaller overhead and is faster to parse, but
+	/// is understood only by robots with runtime that supports it.
+	/// @param enabled - true for compact binary frames, false for text length-prefixed frames.
+	/// @param compress - if true, large messages in binary frames are compressed.
+	void setBinaryFraming(bool enabled, bool compress);
+
+	/// Sets maximal size of a file that can be received from other robots, larger files are rejected.
+	/// @param bytes - maximal file size in bytes, 0 means unlimited.
+	void setMaxReceivedFileSize(qint64 bytes);
+
 	/// Connects to robot by IP and port.
 	void connect(QString const &ip, int port);
 
@@ -69,27 +96,95 @@ public slots:
 	/// Sends message to all known robots.
 	void send(QString const &message);
 
+	/// Sends binary or typed message to a robot with given hull number. QByteArray is delivered as is, other values
+	/// (numbers, arrays, maps and so on) are serialized and delivered with their types, no conversion to string
+	/// is made on either side.
+	void sendValue(int hullNumber, QVariant const &value);
+
+	/// Sends binary or typed message to all known robots.
+	void sendValue(QVariant const &value);
+
+	/// Sends a file to a robot with given hull number, or to all known robots if hull number is -1. Returns
+	/// immediately, file is sent by chunks in background and verified by receiver.
+	void sendFile(int hullNumber, QString const &path);
+
+	/// Sends given data to a robot with given hull number (or to all known robots if hull number is -1), receiver
+	/// gets it as a file with given name.
+	void sendBlob(int hullNumber, QString const &name, QByteArray const &data);
+
 	/// Returns true if there are incoming messages. Returns immediately.
 	bool hasMessages();
 
+	/// Returns true if there are incoming messages from a robot with given hull number. Returns immediately.
+	bool hasMessages(int hullNumber);
+
 	/// Receives and returns one incoming message. If there is already a message in a queue, returns immediately,
 	/// otherwise blocks until a message is received. Note that if receive() and handler for newMessage() is used
 	/// simultaneously, message will be delivered twice --- first for receive(), then to handler (or handlers).
 	QString receive();
 
+	/// Receives and returns one incoming message from a robot with given hull number, messages from other robots
+	/// stay in their queues. Blocks until a message is received, timeout expires or script is stopped, returns
+	/// empty string in two latter cases.
+	/// @param hullNumber - hull number of a sender, -1 means any robot.
+	/// @param timeoutMs - maximal time to wait in milliseconds, -1 means no timeout.
+	QString receive(int hullNumber, int timeoutMs = -1);
+
+	/// Receives and returns one incoming message as is, with its type, blocks like receive(). Returns invalid value
+	/// if timeout expires or script is stopped.
+	/// @param hullNumber - hull number of a sender, -1 means any robot.
+	/// @param timeoutMs - maximal time to wait in milliseconds, -1 means no timeout.
+	QVariant receiveValue(int hullNumber = -1, int timeoutMs = -1);
+
 	/// Returns hull number of this robot.
 	int myHullNumber() const;
 
+	/// Returns sending statistics for every link to other robots: map from "<ip>:<port>" to a map with number of
+	/// sent "messages", number of network "writes" and "messagesPerWrite" ratio.
+	QVariantMap linkStatistics() const;
+
+	/// Returns network statistics for every robot, measured by periodic pings: map from hull number to a map with
+	/// last, minimal and average round-trip times ("rtt", "minRtt", "averageRtt"), estimated offset of robot's
+	/// clock relative to ours ("clockOffset") and number of pings ("samples"). All times are in microseconds.
+	QVariantMap peerStatistics() const;
+
+	/// Returns how long ago the last message returned by receive() or receiveValue() was sent, in milliseconds.
+	/// Sender time is converted to our clock using estimated clock offset, so robot clocks need not be
+	/// synchronised. Returns -1 if it is unknown, for example, if sender was not pinged yet.
+	int lastMessageAge() const;
+
 signals:
 	/// Emitted when new message is received from a robot with given hull number. Note that if receive() and
 	/// handler for newMessage() is used simultaneously, message will be delivered twice --- first for receive(), then
 	/// to handler (or handlers).
 	void newMessage(int sender, QString const &message);
 
+	/// Emitted when new binary or typed message is received from a robot with given hull number. Same note about
+	/// receiveValue() as for newMessage() applies.
+	void newValue(int sender, QVariant const &value);
+
+	/// Emitted when a file sent by sendFile() or sendBlob() is completely received from a robot with given hull
+	/// number. File is stored in a temporary directory, script shall move it if it is needed.
+	void fileReceived(int sender, QString const &path);
+
 	/// Used to interrupt waiting for new message.
 	void stopWaiting();
 
+private slots:
+	/// Marks current waiting for a message as aborted.
+	void abortWaiting();
+
 private:
+	/// Blocks until there is a message from given robot in a queue, timeout expires or waiting is interrupted.
+	/// Returns true if there is a message.
+	bool waitForMessage(int hullNumber, int timeoutMs);
+
+	/// Time when the last received message was sent, on trikKernel::MonotonicClock in microseconds, or -1.
+	qint64 mLastMessageSendTime = -1;
+
+	/// Nonzero if waiting for a message was aborted by stopWaiting().
+	QAtomicInt mWaitAborted;
+
 	/// Server that works in separate thread.
 	QScopedPointer<MailboxServer> mWorker;
 
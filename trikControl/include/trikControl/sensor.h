@@ -35,6 +35,10 @@ public:
 		, specialSensor
 	};
 
+	/// Converts raw reading of a sensor, as returned by readRawData(), to a value returned by read(). Allows to get
+	/// both values by one hardware read.
+	virtual int valueFromRaw(int rawValue) const = 0;
+
 public slots:
 	/// Returns current raw reading of a sensor.
 	virtual int read() = 0;
@@ -51,12 +51,12 @@ AnalogSensor::AnalogSensor(I2cCommunicator &communicator
 
 int AnalogSensor::read()
 {
-	QByteArray command(1, '\0');
-	command[0] = static_cast<char>(mI2cCommandNumber & 0xFF);
-
-	int value = mK * mCommunicator.read(command) + mB;
+	return valueFromRaw(readRawData());
+}
 
-	return value;
+int AnalogSensor::valueFromRaw(int rawValue) const
+{
+	return mK * rawValue + mB;
 }
 
 int AnalogSensor::readRawData()
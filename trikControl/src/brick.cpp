@@ -25,6 +25,7 @@
 #include "powerMotor.h"
 
 #include "configurer.h"
+#include "flightRecorder.h"
 #include "i2cCommunicator.h"
 
 #include "QsLog.h"
@@ -159,7 +160,8 @@ Brick::Brick(QThread &guiThread, QString const &configFilePath, const QString &s
 			);
 
 	if (mConfigurer->hasGamepad()) {
-		mGamepad = new Gamepad(mConfigurer->gamepadPort());
+		mGamepad = new Gamepad(mConfigurer->gamepadPort(), mConfigurer->gamepadUsesUdp()
+				, mConfigurer->gamepadUsesLegacyFraming());
 	}
 
 	if (mConfigurer->hasLineSensor()) {
@@ -188,13 +190,38 @@ Brick::Brick(QThread &guiThread, QString const &configFilePath, const QString &s
 	}
 
 	if (mConfigurer->hasMailbox()) {
-		mMailbox.reset(new Mailbox(mConfigurer->mailboxServerPort()));
+		mMailbox.reset(new Mailbox(mConfigurer->mailboxServerPort()
+				, mConfigurer->mailboxMulticastGroup()
+				, mConfigurer->mailboxMulticastPort()
+				));
+
+		mMailbox->setQueueLimit(mConfigurer->mailboxQueueSize(), mConfigurer->mailboxBackpressure());
+		mMailbox->setBatchWindow(mConfigurer->mailboxBatchWindow());
+		mMailbox->setBinaryFraming(mConfigurer->mailboxBinaryFraming(), mConfigurer->mailboxCompression());
+		mMailbox->setMaxReceivedFileSize(mConfigurer->mailboxMaxFileSize());
 		QObject::connect(this, SIGNAL(stopWaiting()), mMailbox.data(), SIGNAL(stopWaiting()));
 	}
+
+	if (mConfigurer->hasDisplayMirror()) {
+		mDisplay.startMirroring(mConfigurer->displayMirrorPort()
+				, mConfigurer->displayMirrorMaxFps()
+				, mConfigurer->displayMirrorTileSize()
+				);
+	}
+
+	if (mConfigurer->hasFlightRecorder()) {
+		mFlightRecorder = new FlightRecorder(*this
+				, mConfigurer->flightRecorderFile()
+				, mConfigurer->flightRecorderRate()
+				, mConfigurer->flightRecorderDuration()
+				);
+	}
 }
 
 Brick::~Brick()
 {
+	// Recorder samples devices, so it shall be stopped before they are deleted.
+	delete mFlightRecorder;
 	delete mConfigurer;
 	qDeleteAll(mServoMotors);
 	qDeleteAll(mPwmCaptures);
@@ -431,6 +458,11 @@ Mailbox *Brick::mailbox()
 	return mMailbox.data();
 }
 
+QByteArray Brick::flightRecord()
+{
+	return mFlightRecorder != nullptr ? mFlightRecorder->contents() : QByteArray();
+}
+
 void Brick::run()
 {
 	mInEventDrivenMode = true;
@@ -441,6 +473,11 @@ bool Brick::isInEventDrivenMode() const
 	return mInEventDrivenMode;
 }
 
+int Brick::abortDeadline() const
+{
+	return mConfigurer->abortDeadline();
+}
+
 void Brick::quit()
 {
 	emit quitSignal();
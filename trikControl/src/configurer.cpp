@@ -73,6 +73,9 @@ Configurer::Configurer(QString const &configFilePath)
 	mObjectSensor = loadVirtualSensor(root, "objectSensor");
 	mMxNColorSensor = loadVirtualSensor(root, "colorSensor");
 	loadMailbox(root);
+	loadDisplayMirror(root);
+	loadFlightRecorder(root);
+	loadScriptRunner(root);
 }
 
 QString Configurer::initScript() const
@@ -355,6 +358,16 @@ int Configurer::gamepadPort() const
 	return mGamepadPort;
 }
 
+bool Configurer::gamepadUsesUdp() const
+{
+	return mGamepadUsesUdp;
+}
+
+bool Configurer::gamepadUsesLegacyFraming() const
+{
+	return mGamepadUsesLegacyFraming;
+}
+
 bool Configurer::hasLineSensor() const
 {
 	return mLineSensor.enabled;
@@ -445,6 +458,91 @@ int Configurer::mailboxServerPort() const
 	return mMailboxServerPort;
 }
 
+QString Configurer::mailboxMulticastGroup() const
+{
+	return mMailboxMulticastGroup;
+}
+
+int Configurer::mailboxMulticastPort() const
+{
+	return mMailboxMulticastPort;
+}
+
+int Configurer::mailboxQueueSize() const
+{
+	return mMailboxQueueSize;
+}
+
+bool Configurer::mailboxBackpressure() const
+{
+	return mMailboxBackpressure;
+}
+
+int Configurer::mailboxBatchWindow() const
+{
+	return mMailboxBatchWindow;
+}
+
+bool Configurer::mailboxBinaryFraming() const
+{
+	return mMailboxBinaryFraming;
+}
+
+bool Configurer::mailboxCompression() const
+{
+	return mMailboxCompression;
+}
+
+qint64 Configurer::mailboxMaxFileSize() const
+{
+	return mMailboxMaxFileSize;
+}
+
+bool Configurer::hasDisplayMirror() const
+{
+	return mIsDisplayMirrorEnabled;
+}
+
+int Configurer::displayMirrorPort() const
+{
+	return mDisplayMirrorPort;
+}
+
+int Configurer::displayMirrorMaxFps() const
+{
+	return mDisplayMirrorMaxFps;
+}
+
+int Configurer::displayMirrorTileSize() const
+{
+	return mDisplayMirrorTileSize;
+}
+
+bool Configurer::hasFlightRecorder() const
+{
+	return mIsFlightRecorderEnabled;
+}
+
+QString Configurer::flightRecorderFile() const
+{
+	return mFlightRecorderFile;
+}
+
+int Configurer::flightRecorderRate() const
+{
+	return mFlightRecorderRate;
+}
+
+int Configurer::flightRecorderDuration() const
+{
+	return mFlightRecorderDuration;
+}
+
+int Configurer::abortDeadline() const
+{
+	return mAbortDeadline;
+}
+
 void Configurer::loadInit(QDomElement const &root)
 {
 	if (root.elementsByTagName("initScript").isEmpty()) {
@@ -840,6 +938,8 @@ void Configurer::loadGamepadPort(QDomElement const &root)
 	if (isEnabled(root, "gamepad")) {
 		QDomElement gamepad = root.elementsByTagName("gamepad").at(0).toElement();
 		mGamepadPort = gamepad.attribute("port").toInt(nullptr, 0);
+		mGamepadUsesUdp = gamepad.attribute("protocol", "tcp") == "udp";
+		mGamepadUsesLegacyFraming = gamepad.attribute("protocol", "tcp") == "tcpLegacy";
 		mIsGamepadEnabled = true;
 	}
 }
@@ -869,10 +969,51 @@ void Configurer::loadMailbox(QDomElement const &root)
 	if (isEnabled(root, "mailbox")) {
 		QDomElement mailboxElement = root.elementsByTagName("mailbox").at(0).toElement();
 		mMailboxServerPort = mailboxElement.attribute("port").toInt();
+		mMailboxMulticastGroup = mailboxElement.attribute("multicastGroup");
+		mMailboxMulticastPort = mailboxElement.attribute("multicastPort", "8888").toInt();
+		mMailboxQueueSize = mailboxElement.attribute("queueSize", "0").toInt();
+		mMailboxBackpressure = mailboxElement.attribute("overflowPolicy", "dropOldest") == "backpressure";
+		mMailboxBatchWindow = mailboxElement.attribute("mode", "lowLatency") == "throughput"
+				? mailboxElement.attribute("batchWindow", "5").toInt()
+				: 0;
+		QString const framing = mailboxElement.attribute("framing", "text");
+		mMailboxBinaryFraming = framing == "binary" || framing == "compressedBinary";
+		mMailboxCompression = framing == "compressedBinary";
+		mMailboxMaxFileSize = mailboxElement.attribute("maxFileSize", "16777216").toLongLong();
 		mIsMailboxEnabled = true;
 	}
 }
 
+void Configurer::loadDisplayMirror(QDomElement const &root)
+{
+	if (isEnabled(root, "displayMirror")) {
+		QDomElement mirrorElement = root.elementsByTagName("displayMirror").at(0).toElement();
+		mDisplayMirrorPort = mirrorElement.attribute("port").toInt();
+		mDisplayMirrorMaxFps = mirrorElement.attribute("maxFps", "10").toInt();
+		mDisplayMirrorTileSize = mirrorElement.attribute("tileSize", "32").toInt();
+		mIsDisplayMirrorEnabled = true;
+	}
+}
+
+void Configurer::loadFlightRecorder(QDomElement const &root)
+{
+	if (isEnabled(root, "flightRecorder")) {
+		QDomElement recorderElement = root.elementsByTagName("flightRecorder").at(0).toElement();
+		mFlightRecorderFile = recorderElement.attribute("file", "/tmp/flightRecord.bin");
+		mFlightRecorderRate = recorderElement.attribute("rate", "50").toInt();
+		mFlightRecorderDuration = recorderElement.attribute("duration", "60").toInt();
+		mIsFlightRecorderEnabled = true;
+	}
+}
+
+void Configurer::loadScriptRunner(QDomElement const &root)
+{
+	if (root.elementsByTagName("scriptRunner").size() > 0) {
+		QDomElement scriptRunnerElement = root.elementsByTagName("scriptRunner").at(0).toElement();
+		mAbortDeadline = scriptRunnerElement.attribute("abortDeadline", "1000").toInt();
+	}
+}
+
 bool Configurer::isEnabled(QDomElement const &root, QString const &tagName)
 {
 	return root.elementsByTagName(tagName).size() > 0
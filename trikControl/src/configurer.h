@@ -151,6 +151,10 @@ public:
 
 	int gamepadPort() const;
 
+	bool gamepadUsesUdp() const;
+
+	bool gamepadUsesLegacyFraming() const;
+
 	bool hasLineSensor() const;
 
 	QString lineSensorScript() const;
@@ -187,6 +191,40 @@ public:
 
 	int mailboxServerPort() const;
 
+	QString mailboxMulticastGroup() const;
+
+	int mailboxMulticastPort() const;
+
+	int mailboxQueueSize() const;
+
+	bool mailboxBackpressure() const;
+
+	int mailboxBatchWindow() const;
+
+	bool mailboxBinaryFraming() const;
+
+	bool mailboxCompression() const;
+
+	qint64 mailboxMaxFileSize() const;
+
+	bool hasDisplayMirror() const;
+
+	int displayMirrorPort() const;
+
+	int displayMirrorMaxFps() const;
+
+	int displayMirrorTileSize() const;
+
+	bool hasFlightRecorder() const;
+
+	QString flightRecorderFile() const;
+
+	int flightRecorderRate() const;
+
+	int flightRecorderDuration() const;
+
+	int abortDeadline() const;
+
 private:
 	enum ServoType {
 		angular
@@ -290,6 +328,9 @@ private:
 	void loadGamepadPort(QDomElement const &root);
 	VirtualSensor loadVirtualSensor(QDomElement const &root, QString const &tagName);
 	void loadMailbox(QDomElement const &root);
+	void loadDisplayMirror(QDomElement const &root);
+	void loadFlightRecorder(QDomElement const &root);
+	void loadScriptRunner(QDomElement const &root);
 
 	static bool isEnabled(QDomElement const &root, QString const &tagName);
 
@@ -320,6 +361,8 @@ private:
 	int mLedOff = 0;
 
 	int mGamepadPort = 0;
+	bool mGamepadUsesUdp = false;
+	bool mGamepadUsesLegacyFraming = false;
 	bool mIsGamepadEnabled = false;
 
 	VirtualSensor mLineSensor;
@@ -329,7 +372,27 @@ private:
 	int mColorSensorN = 0;
 
 	int mMailboxServerPort = 0;
+	QString mMailboxMulticastGroup;
+	int mMailboxMulticastPort = 0;
+	int mMailboxQueueSize = 0;
+	bool mMailboxBackpressure = false;
+	int mMailboxBatchWindow = 0;
+	bool mMailboxBinaryFraming = false;
+	bool mMailboxCompression = false;
+	qint64 mMailboxMaxFileSize = 0;
 	bool mIsMailboxEnabled = false;
+
+	int mDisplayMirrorPort = 0;
+	int mDisplayMirrorMaxFps = 0;
+	int mDisplayMirrorTileSize = 0;
+	bool mIsDisplayMirrorEnabled = false;
+
+	QString mFlightRecorderFile;
+	int mFlightRecorderRate = 0;
+	int mFlightRecorderDuration = 0;
+	bool mIsFlightRecorderEnabled = false;
+
+	int mAbortDeadline = 1000;
 };
 
 }
@@ -29,24 +29,20 @@ DigitalSensor::DigitalSensor(int min, int max, QString const &deviceFile)
 
 int DigitalSensor::read()
 {
-	if (!mDeviceFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-		QLOG_ERROR() << "File " << mDeviceFile.fileName() << " failed to open for reading";
-		qDebug() << "File " << mDeviceFile.fileName() << " failed to open for reading";
-		return 0;
+	if (mMax == mMin) {
+		return mMin;
 	}
 
-	mStream.setDevice(&mDeviceFile);
+	return valueFromRaw(readRawData());
+}
 
+int DigitalSensor::valueFromRaw(int rawValue) const
+{
 	if (mMax == mMin) {
 		return mMin;
 	}
 
-	int value = 0;
-	mStream >> value;
-
-	mDeviceFile.close();
-
-	value = qMin(value, mMax);
+	int value = qMin(rawValue, mMax);
 	value = qMax(value, mMin);
 
 	double const scale = 100.0 / (static_cast<double>(mMax - mMin));
@@ -58,6 +54,7 @@ int DigitalSensor::read()
 
 int DigitalSensor::readRawData()
 {
+	QMutexLocker locker(&mMutex);
 	if (!mDeviceFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
 		QLOG_ERROR() << "File " << mDeviceFile.fileName() << " failed to open for reading";
 		qDebug() << "File " << mDeviceFile.fileName() << " failed to open for reading";
@@ -42,6 +42,12 @@ Display::~Display()
 	mGuiThread.wait(1000);
 }
 
+void Display::startMirroring(int port, int maxFps, int tileSize)
+{
+	QMetaObject::invokeMethod(mGuiWorker, "startMirroring", Q_ARG(int, port), Q_ARG(int, maxFps)
+			, Q_ARG(int, tileSize));
+}
+
 void Display::showImage(QString const &fileName)
 {
 	QMetaObject::invokeMethod(mGuiWorker, "showImage", Q_ARG(QString, fileName));
@@ -119,3 +125,26 @@ void Display::setPainterWidth(int penWidth)
 {
 	QMetaObject::invokeMethod(mGuiWorker, "setPainterWidth", Q_ARG(int, penWidth));
 }
+
+void Display::drawBuffer(int width, int height, QImage::Format format, QByteArray const &data)
+{
+	QMetaObject::invokeMethod(mGuiWorker, "drawBuffer", Q_ARG(QByteArray, data), Q_ARG(int, width)
+			, Q_ARG(int, height), Q_ARG(int, format));
+}
+
+void Display::drawBuffer(QVector<int> const &pixels, int width, int height)
+{
+	QMetaObject::invokeMethod(mGuiWorker, "drawBuffer", Q_ARG(QVector<int>, pixels), Q_ARG(int, width)
+			, Q_ARG(int, height));
+}
+
+void Display::drawSharedBuffer(QString const &key, int width, int height, QImage::Format format)
+{
+	QMetaObject::invokeMethod(mGuiWorker, "drawSharedBuffer", Q_ARG(QString, key), Q_ARG(int, width)
+			, Q_ARG(int, height), Q_ARG(int, format));
+}
+
+void Display::drawSharedBuffer(QString const &key, int width, int height)
+{
+	drawSharedBuffer(key, width, height, QImage::Format_RGB32);
+}
@@ -0,0 +1,189 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "displayMirror.h"
+
+#include <cstring>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtGui/QPixmap>
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	#include <QtGui/QWidget>
+#else
+	#include <QtWidgets/QWidget>
+#endif
+
+#include "QsLog.h"
+
+using namespace trikControl;
+
+/// If some client has more than this amount of bytes not yet sent, new frames are not grabbed.
+qint64 const maxPendingBytes = 256 * 1024;
+
+/// Compression level for tiles. Fastest one, display contents compresses well anyway.
+int const compressionLevel = 1;
+
+DisplayMirror::DisplayMirror(QWidget &display, int port, int maxFps, int tileSize)
+	: mDisplay(display)
+	, mDirty(true)
+	, mTileSize(qMax(tileSize, 8))
+{
+	connect(&mServer, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+	connect(&mFrameTimer, SIGNAL(timeout()), this, SLOT(sendFrame()));
+
+	if (!mServer.listen(QHostAddress::Any, port)) {
+		QLOG_ERROR() << "Unable to start display mirror on port" << port << ":" << mServer.errorString();
+		qDebug() << "Unable to start display mirror on port" << port << ":" << mServer.errorString();
+		return;
+	}
+
+	mFrameTimer.setInterval(1000 / qMax(maxFps, 1));
+
+	QLOG_INFO() << "Display mirror started on port" << port;
+	qDebug() << "Display mirror started on port" << port;
+}
+
+DisplayMirror::~DisplayMirror()
+{
+	for (QTcpSocket * const client : mClients) {
+		client->disconnect(this);
+	}
+
+	qDeleteAll(mClients);
+}
+
+void DisplayMirror::markDirty()
+{
+	mDirty = true;
+}
+
+void DisplayMirror::onNewConnection()
+{
+	while (mServer.hasPendingConnections()) {
+		QTcpSocket * const client = mServer.nextPendingConnection();
+
+		// We will own it ourselves.
+		client->setParent(nullptr);
+
+		connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+		mClients.append(client);
+
+		QLOG_INFO() << "Display mirror client connected:" << client->peerAddress();
+		qDebug() << "Display mirror client connected:" << client->peerAddress();
+	}
+
+	// New client needs full frame.
+	mPreviousFrame = QImage();
+	mDirty = true;
+	mFrameTimer.start();
+}
+
+void DisplayMirror::onDisconnected()
+{
+	QTcpSocket * const client = static_cast<QTcpSocket *>(sender());
+	mClients.removeAll(client);
+	client->deleteLater();
+
+	if (mClients.isEmpty()) {
+		mFrameTimer.stop();
+	}
+}
+
+void DisplayMirror::sendFrame()
+{
+	if (!mDirty || mClients.isEmpty()) {
+		return;
+	}
+
+	for (QTcpSocket const * const client : mClients) {
+		if (client->bytesToWrite() > maxPendingBytes) {
+			// Slow client, skip this frame, display stays dirty and will be sent later.
+			return;
+		}
+	}
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	QImage const frame = QPixmap::grabWidget(&mDisplay).toImage().convertToFormat(QImage::Format_RGB16);
+#else
+	QImage const frame = mDisplay.grab().toImage().convertToFormat(QImage::Format_RGB16);
+#endif
+
+	mDirty = false;
+
+	if (mPreviousFrame.size() != frame.size()) {
+		mPreviousFrame = QImage();
+	}
+
+	QByteArray tiles;
+	QDataStream tilesStream(&tiles, QIODevice::WriteOnly);
+	int const tilesCount = appendChangedTiles(frame, tilesStream);
+	mPreviousFrame = frame;
+
+	if (tilesCount == 0) {
+		return;
+	}
+
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << quint32(0) << quint16(frame.width()) << quint16(frame.height()) << quint16(tilesCount);
+	stream.writeRawData(tiles.constData(), tiles.size());
+
+	// Now when size is known, writing it in place of placeholder.
+	stream.device()->seek(0);
+	stream << quint32(data.size() - sizeof(quint32));
+
+	for (QTcpSocket * const client : mClients) {
+		client->write(data);
+	}
+}
+
+int DisplayMirror::appendChangedTiles(QImage const &frame, QDataStream &stream) const
+{
+	int const bytesPerPixel = frame.depth() / 8;
+	int count = 0;
+
+	for (int tileY = 0; tileY < frame.height(); tileY += mTileSize) {
+		for (int tileX = 0; tileX < frame.width(); tileX += mTileSize) {
+			int const width = qMin(mTileSize, frame.width() - tileX);
+			int const height = qMin(mTileSize, frame.height() - tileY);
+			int const lineBytes = width * bytesPerPixel;
+
+			bool changed = mPreviousFrame.isNull();
+			for (int y = tileY; !changed && y < tileY + height; ++y) {
+				changed = std::memcmp(frame.constScanLine(y) + tileX * bytesPerPixel
+						, mPreviousFrame.constScanLine(y) + tileX * bytesPerPixel, lineBytes) != 0;
+			}
+
+			if (!changed) {
+				continue;
+			}
+
+			QByteArray pixels;
+			pixels.reserve(lineBytes * height);
+			for (int y = tileY; y < tileY + height; ++y) {
+				pixels.append(reinterpret_cast<char const *>(frame.constScanLine(y) + tileX * bytesPerPixel)
+						, lineBytes);
+			}
+
+			stream << quint16(tileX) << quint16(tileY) << quint16(width) << quint16(height)
+					<< qCompress(pixels, compressionLevel);
+
+			++count;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,77 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+#include <QtGui/QImage>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+class QWidget;
+
+namespace trikControl {
+
+/// Streams contents of a display widget to TCP clients, for remote debugging. Works in GUI thread. Display is split
+/// into square tiles, only tiles that changed since previous frame are sent, each tile compressed separately. Frames
+/// are grabbed only when something was drawn and there is at least one client, and no more often than given
+/// frame rate cap. If some client can not keep up, frames are skipped until its socket buffer drains.
+///
+/// Stream is a sequence of frames, each frame is quint32 frame size in bytes followed by frame data in QDataStream
+/// format: quint16 display width, quint16 display height, quint16 tiles count, then for each tile quint16 x,
+/// quint16 y, quint16 width, quint16 height and QByteArray with qCompress-ed RGB16 pixels of a tile, line by line.
+/// First frame sent to a newly connected client contains whole display.
+class DisplayMirror : public QObject
+{
+	Q_OBJECT
+
+public:
+	/// Constructor.
+	/// @param display - widget whose contents shall be streamed.
+	/// @param port - TCP port to listen for clients.
+	/// @param maxFps - maximal number of frames per second to send.
+	/// @param tileSize - size of a side of a tile in pixels.
+	DisplayMirror(QWidget &display, int port, int maxFps, int tileSize);
+
+	~DisplayMirror() override;
+
+	/// Notifies mirror that display contents has changed and shall be sent with next frame.
+	void markDirty();
+
+private slots:
+	void onNewConnection();
+	void onDisconnected();
+	void sendFrame();
+
+private:
+	/// Appends tiles that differ between given frame and previous frame to a stream, returns count of such tiles.
+	int appendChangedTiles(QImage const &frame, QDataStream &stream) const;
+
+	QWidget &mDisplay;
+	QTcpServer mServer;
+	QList<QTcpSocket *> mClients;  // Has ownership.
+	QTimer mFrameTimer;
+
+	/// Last frame sent to clients, null if clients need full frame.
+	QImage mPreviousFrame;
+
+	/// True if display was changed since last sent frame.
+	bool mDirty;
+
+	int const mTileSize;
+};
+
+}
@@ -36,11 +36,12 @@ void Encoder::reset()
 
 int Encoder::read()
 {
-	QByteArray command(2, '\0');
-	command[0] = static_cast<char>(mI2cCommandNumber);
-	int data = mCommunicator.read(command);
+	return valueFromRaw(readRawData());
+}
 
-	return mRawToDegrees * data;
+int Encoder::valueFromRaw(int rawValue) const
+{
+	return mRawToDegrees * rawValue;
 }
 
 int Encoder::readRawData()
@@ -0,0 +1,198 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "flightRecorder.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QtEndian>
+
+#include <trikKernel/monotonicClock.h>
+
+#include "brick.h"
+
+#include "QsLog.h"
+
+using namespace trikControl;
+
+/// Size of a file header, schema shall fit into it.
+int const headerSize = 4096;
+
+/// Offsets of fields in a header.
+int const recordSizeOffset = 8;
+int const capacityOffset = 12;
+int const recordsCountOffset = 16;
+int const schemaOffset = 24;
+
+FlightRecorder::FlightRecorder(Brick &brick, QString const &filePath, int rate, int duration)
+	: mBrick(brick)
+	, mFile(filePath)
+	, mIntervalMs(1000 / qBound(1, rate, 1000))
+	, mCapacity(static_cast<quint32>(qMax(1, rate * duration)))
+	, mSampleTimer(this)
+{
+	mSensorPorts << mBrick.sensorPorts(Sensor::analogSensor) << mBrick.sensorPorts(Sensor::digitalSensor);
+
+	mEncoderPorts = mBrick.encoderPorts();
+	mMotorPorts << mBrick.motorPorts(Motor::powerMotor) << mBrick.motorPorts(Motor::servoMotor);
+
+	QObject::connect(&mSampleTimer, SIGNAL(timeout()), this, SLOT(sample()));
+
+	moveToThread(&mThread);
+	mThread.start();
+	QMetaObject::invokeMethod(this, "start", Qt::QueuedConnection);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+	QMetaObject::invokeMethod(this, "stop", Qt::BlockingQueuedConnection);
+	mThread.quit();
+	mThread.wait();
+}
+
+QByteArray FlightRecorder::contents()
+{
+	QByteArray result;
+	QMetaObject::invokeMethod(this, "collectContents", Qt::BlockingQueuedConnection
+			, Q_RETURN_ARG(QByteArray, result));
+
+	return result;
+}
+
+void FlightRecorder::start()
+{
+	QStringList schema;
+	for (QString const &port : mSensorPorts + mEncoderPorts) {
+		schema << port + "=1";
+	}
+
+	schema << "AccelerometerPort=3" << "GyroscopePort=3";
+	for (QString const &port : mMotorPorts) {
+		schema << port + "=1";
+	}
+
+	QByteArray const schemaData = schema.join(",").toUtf8();
+	if (schemaOffset + schemaData.size() + 1 > headerSize) {
+		QLOG_ERROR() << "Too many ports for flight recorder, recording is disabled";
+		qDebug() << "Too many ports for flight recorder, recording is disabled";
+		return;
+	}
+
+	mRecordSize = static_cast<quint32>(sizeof(qint64)
+			+ sizeof(qint32) * (mSensorPorts.size() + mEncoderPorts.size() + 3 + 3 + mMotorPorts.size()));
+
+	// Keeping record of previous run, it may be the one that ended with a failure.
+	if (mFile.exists()) {
+		QString const previousPath = mFile.fileName() + ".previous";
+		QFile::remove(previousPath);
+		QFile::rename(mFile.fileName(), previousPath);
+	}
+
+	qint64 const fileSize = headerSize + static_cast<qint64>(mRecordSize) * mCapacity;
+	if (!mFile.open(QIODevice::ReadWrite | QIODevice::Truncate) || !mFile.resize(fileSize)) {
+		QLOG_ERROR() << "Can not create flight recorder file" << mFile.fileName() << ":" << mFile.errorString();
+		qDebug() << "Can not create flight recorder file" << mFile.fileName() << ":" << mFile.errorString();
+		return;
+	}
+
+	mMap = mFile.map(0, fileSize);
+	if (mMap == nullptr) {
+		QLOG_ERROR() << "Can not map flight recorder file" << mFile.fileName() << ":" << mFile.errorString();
+		qDebug() << "Can not map flight recorder file" << mFile.fileName() << ":" << mFile.errorString();
+		mFile.close();
+		return;
+	}
+
+	memset(mMap, 0, headerSize);
+	memcpy(mMap, "TRIKFR01", 8);
+	qToLittleEndian<quint32>(mRecordSize, mMap + recordSizeOffset);
+	qToLittleEndian<quint32>(mCapacity, mMap + capacityOffset);
+	memcpy(mMap + schemaOffset, schemaData.constData(), schemaData.size());
+	writeRecordsCount();
+
+	QLOG_INFO() << "Flight recorder started, file" << mFile.fileName() << ", capacity" << mCapacity << "records";
+
+	mSampleTimer.start(mIntervalMs);
+}
+
+void FlightRecorder::stop()
+{
+	mSampleTimer.stop();
+	if (mMap != nullptr) {
+		mFile.unmap(mMap);
+		mMap = nullptr;
+	}
+
+	mFile.close();
+}
+
+void FlightRecorder::sample()
+{
+	uchar *record = mMap + headerSize + (mRecordsCount % mCapacity) * mRecordSize;
+
+	qToLittleEndian<qint64>(trikKernel::MonotonicClock::microseconds(), record);
+	record += sizeof(qint64);
+
+	auto const writeValue = [&record](int value) {
+		qToLittleEndian<qint32>(value, record);
+		record += sizeof(qint32);
+	};
+
+	for (QString const &port : mSensorPorts) {
+		writeValue(mBrick.sensor(port)->read());
+	}
+
+	for (QString const &port : mEncoderPorts) {
+		writeValue(mBrick.encoder(port)->read());
+	}
+
+	for (Sensor3d * const sensor : {mBrick.accelerometer(), mBrick.gyroscope()}) {
+		// Disabled accelerometer or gyroscope is recorded as zeros to keep record layout fixed.
+		QVector<int> const value = sensor != nullptr ? sensor->read() : QVector<int>();
+		for (int i = 0; i < 3; ++i) {
+			writeValue(i < value.size() ? value[i] : 0);
+		}
+	}
+
+	for (QString const &port : mMotorPorts) {
+		writeValue(mBrick.motor(port)->power());
+	}
+
+	// Count is updated after a record, so a reader never sees a half-written record as complete.
+	++mRecordsCount;
+	writeRecordsCount();
+}
+
+void FlightRecorder::writeRecordsCount()
+{
+	qToLittleEndian<quint64>(mRecordsCount, mMap + recordsCountOffset);
+}
+
+QByteArray FlightRecorder::collectContents() const
+{
+	if (mMap == nullptr) {
+		return QByteArray();
+	}
+
+	quint64 const storedRecords = qMin<quint64>(mRecordsCount, mCapacity);
+	quint64 const firstRecord = mRecordsCount - storedRecords;
+
+	QByteArray result(reinterpret_cast<char const *>(mMap), headerSize);
+	result.reserve(static_cast<int>(headerSize + storedRecords * mRecordSize));
+	for (quint64 i = firstRecord; i < mRecordsCount; ++i) {
+		result.append(reinterpret_cast<char const *>(mMap + headerSize + (i % mCapacity) * mRecordSize)
+				, static_cast<int>(mRecordSize));
+	}
+
+	return result;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+namespace trikControl {
+
+class Brick;
+
+/// Continuously records values of all sensors, encoders, accelerometer and gyroscope axes and powers of all motors
+/// into a preallocated memory-mapped ring file, so what a robot did in the last seconds can be reconstructed after
+/// a failure. Samples are taken in a separate thread, writing a sample is just a memory copy, kernel writes pages
+/// to a file by itself, so file survives crash of a runtime. Previous file is kept with ".previous" suffix.
+///
+/// File format (all numbers are little-endian): 4096 bytes header --- "TRIKFR01" magic, quint32 record size,
+/// quint32 capacity in records, quint64 number of records written so far, then UTF-8 schema
+/// "<port>=<number of values>,..." terminated by zero byte. Header is followed by ring of records, record number N
+/// is at position N % capacity, each record is qint64 timestamp in microseconds (see trikKernel::MonotonicClock)
+/// followed by qint32 values in schema order.
+class FlightRecorder : public QObject
+{
+	Q_OBJECT
+
+public:
+	/// Constructor. Starts recording immediately.
+	/// @param brick - brick whose devices are recorded. All devices shall be already created.
+	/// @param filePath - path to a ring file.
+	/// @param rate - number of samples per second.
+	/// @param duration - number of seconds of history kept in a file.
+	FlightRecorder(Brick &brick, QString const &filePath, int rate, int duration);
+
+	~FlightRecorder() override;
+
+	/// Returns recorded data in the same format as a ring file, but with records in chronological order starting
+	/// right after a header. Thread-safe.
+	QByteArray contents();
+
+private slots:
+	/// Creates and maps a ring file and starts sampling. Called in a recorder thread.
+	void start();
+
+	/// Stops sampling and unmaps a file. Called in a recorder thread.
+	void stop();
+
+	/// Takes one sample and writes it into a ring.
+	void sample();
+
+	/// Implementation of contents(), called in a recorder thread.
+	QByteArray collectContents() const;
+
+private:
+	/// Writes number of records written so far into a header.
+	void writeRecordsCount();
+
+	Brick &mBrick;
+	QFile mFile;
+
+	/// Ports in schema order.
+	QStringList mSensorPorts;
+	QStringList mEncoderPorts;
+	QStringList mMotorPorts;
+
+	int const mIntervalMs;
+	quint32 const mCapacity;
+	quint32 mRecordSize = 0;
+
+	/// Memory-mapped file, nullptr if mapping failed.
+	uchar *mMap = nullptr;
+
+	/// Number of records written so far.
+	quint64 mRecordsCount = 0;
+
+	QTimer mSampleTimer;
+	QThread mThread;
+};
+
+}
@@ -16,16 +16,26 @@
 
 #include <QtCore/QStringList>
 
+#include <trikKernel/monotonicClock.h>
+
 #include "tcpConnector.h"
+#include "udpConnector.h"
 
 #include "QsLog.h"
 
 using namespace trikControl;
 
-Gamepad::Gamepad(int port)
-	: mListener(new TcpConnector(port))
+Gamepad::Gamepad(int port, bool useUdp, bool legacyFraming)
 {
-	connect(mListener.data(), SIGNAL(dataReady(QString)), this, SLOT(parse(QString)));
+	qRegisterMetaType<qint64>("qint64");
+
+	if (useUdp) {
+		mListener.reset(new UdpConnector(port));
+	} else {
+		mListener.reset(new TcpConnector(port, legacyFraming));
+	}
+
+	connect(mListener.data(), SIGNAL(dataReady(QString, qint64)), this, SLOT(parse(QString, qint64)));
 	connect(&mNetworkThread, SIGNAL(started()), mListener.data(), SLOT(startServer()));
 	mListener->moveToThread(&mNetworkThread);
 	mNetworkThread.start();
@@ -33,60 +43,149 @@ Gamepad::Gamepad(int port)
 
 Gamepad::~Gamepad()
 {
+	mNetworkThread.quit();
+	mNetworkThread.wait();
 }
 
 void Gamepad::reset()
 {
+	QMutexLocker locker(&mStateLock);
 	mButtonWasPressed.clear();
 	mPads.clear();
+	mLastLatency = 0;
+	mMaxLatency = 0;
+	mTotalLatency = 0;
+	mSeenEvents = 0;
 }
 
 bool Gamepad::buttonWasPressed(int buttonNumber)
 {
-	return mButtonWasPressed.remove(buttonNumber);
+	QMutexLocker locker(&mStateLock);
+	if (!mButtonWasPressed.contains(buttonNumber)) {
+		return false;
+	}
+
+	registerSeen(mButtonWasPressed.take(buttonNumber));
+	return true;
 }
 
 bool Gamepad::isPadPressed(int pad)
 {
-	return mPads.contains(pad) && mPads.value(pad).isPressed;
+	QMutexLocker locker(&mStateLock);
+	PadStatus const * const status = seePad(pad);
+	return status && status->isPressed;
 }
 
 int Gamepad::padX(int pad)
 {
-	return (!mPads.contains(pad) || !mPads.value(pad).isPressed) ? -1 : mPads.value(pad).x;
+	QMutexLocker locker(&mStateLock);
+	PadStatus const * const status = seePad(pad);
+	return (!status || !status->isPressed) ? -1 : status->x;
 }
 
 int Gamepad::padY(int pad)
 {
-	return (!mPads.contains(pad) || !mPads.value(pad).isPressed) ? -1 : mPads.value(pad).y;
+	QMutexLocker locker(&mStateLock);
+	PadStatus const * const status = seePad(pad);
+	return (!status || !status->isPressed) ? -1 : status->y;
+}
+
+int Gamepad::lastLatency()
+{
+	QMutexLocker locker(&mStateLock);
+	return static_cast<int>(mLastLatency);
 }
 
-void Gamepad::parse(QString const &message)
+int Gamepad::averageLatency()
+{
+	QMutexLocker locker(&mStateLock);
+	return mSeenEvents == 0 ? 0 : static_cast<int>(mTotalLatency / mSeenEvents);
+}
+
+int Gamepad::maxLatency()
+{
+	QMutexLocker locker(&mStateLock);
+	return static_cast<int>(mMaxLatency);
+}
+
+void Gamepad::registerSeen(qint64 receiveTime)
+{
+	mLastLatency = trikKernel::MonotonicClock::microseconds() - receiveTime;
+	mMaxLatency = qMax(mMaxLatency, mLastLatency);
+	mTotalLatency += mLastLatency;
+	++mSeenEvents;
+}
+
+Gamepad::PadStatus const *Gamepad::seePad(int pad)
+{
+	if (!mPads.contains(pad)) {
+		return nullptr;
+	}
+
+	PadStatus &status = mPads[pad];
+	if (!status.isSeen) {
+		status.isSeen = true;
+		registerSeen(status.receiveTime);
+	}
+
+	return &status;
+}
+
+void Gamepad::parse(QString const &message, qint64 receiveTime)
 {
 	QStringList const cmd = message.split(" ", QString::SkipEmptyParts);
+	if (cmd.isEmpty()) {
+		return;
+	}
+
 	QString const commandName = cmd.at(0).trimmed();
 	if (commandName == "pad") {
+		if (cmd.size() < 3) {
+			QLOG_ERROR() << "Gamepad: malformed command" << message;
+			qDebug() << "Gamepad: malformed command" << message;
+			return;
+		}
+
 		int const padId = cmd.at(1).trimmed().toInt();
 		if (cmd.at(2).trimmed() == "up") {
-			mPads[padId].isPressed = false;
+			{
+				QMutexLocker locker(&mStateLock);
+				PadStatus &status = mPads[padId];
+				status.isPressed = false;
+				status.receiveTime = receiveTime;
+				status.isSeen = false;
+			}
+
 			emit padUp(padId);
+		} else if (cmd.size() < 4) {
+			QLOG_ERROR() << "Gamepad: malformed command" << message;
+			qDebug() << "Gamepad: malformed command" << message;
 		} else {
 			int const x = cmd.at(2).trimmed().toInt();
 			int const y = cmd.at(3).trimmed().toInt();
-			mPads[padId].isPressed = true;
-			mPads[padId].x = x;
-			mPads[padId].y = y;
+			{
+				QMutexLocker locker(&mStateLock);
+				mPads[padId] = PadStatus{x, y, true, receiveTime, false};
+			}
+
 			emit pad(padId, x, y);
 		}
+	} else if (commandName != "btn" && commandName != "wheel") {
+		QLOG_ERROR() << "Gamepad: unknown command" << commandName;
+		qDebug() << "Gamepad: unknown command" << commandName;
+	} else if (cmd.size() < 2) {
+		QLOG_ERROR() << "Gamepad: malformed command" << message;
+		qDebug() << "Gamepad: malformed command" << message;
 	} else if (commandName == "btn") {
 		int const buttonCode = cmd.at(1).trimmed().toInt();
-		mButtonWasPressed.insert(buttonCode);
+		{
+			QMutexLocker locker(&mStateLock);
+			mButtonWasPressed.insert(buttonCode, receiveTime);
+		}
+
 		emit button(buttonCode, 1);
 	} else if (commandName == "wheel") {
 		int const perc = cmd.at(1).trimmed().toInt();
 		emit wheel(perc);
-	} else {
-		QLOG_ERROR() << "Gamepad: unknown command" << commandName;
-		qDebug() << "Gamepad: unknown command" << commandName;
 	}
 }
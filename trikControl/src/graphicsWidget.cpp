@@ -22,6 +22,7 @@ using namespace trikControl;
 GraphicsWidget::GraphicsWidget()
 	: mCurrentPenColor(Qt::black)
 	, mCurrentPenWidth(0)
+	, mPixelBufferSegment(nullptr)
 {
 }
 
@@ -31,6 +32,18 @@ void GraphicsWidget::paintEvent(QPaintEvent *paintEvent)
 
 	QPainter painter(this);
 
+	if (!mPixelBuffer.isNull()) {
+		if (mPixelBufferSegment) {
+			mPixelBufferSegment->lock();
+		}
+
+		painter.drawImage(QPoint(0, 0), mPixelBuffer);
+
+		if (mPixelBufferSegment) {
+			mPixelBufferSegment->unlock();
+		}
+	}
+
 	for (int i = 0; i < mLines.length(); i++)
 	{
 		painter.setPen(QPen(mLines.at(i).color, mLines.at(i).penWidth, Qt::SolidLine, Qt::SquareCap, Qt::BevelJoin));
@@ -74,6 +87,7 @@ void GraphicsWidget::deleteAllItems()
 	mRects.clear();
 	mEllipses.clear();
 	mArcs.clear();
+	setPixelBuffer(QImage());
 }
 
 void GraphicsWidget::setPainterColor(QString const &color)
@@ -244,3 +258,9 @@ QColor GraphicsWidget::currentPenColor() const
 {
 	return mCurrentPenColor;
 }
+
+void GraphicsWidget::setPixelBuffer(QImage const &image, QSharedMemory *segment)
+{
+	mPixelBuffer = image;
+	mPixelBufferSegment = segment;
+}
@@ -17,7 +17,9 @@
 #include <QtCore/QList>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
+#include <QtCore/QSharedMemory>
 #include <QtGui/QColor>
+#include <QtGui/QImage>
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 	#include <QtGui/QWidget>
@@ -80,6 +82,12 @@ public:
 	/// Returns current pen color.
 	QColor currentPenColor() const;
 
+	/// Sets raw pixel buffer that is drawn under all other items. Image is not copied, so pixel data it refers to
+	/// shall stay alive while it is shown.
+	/// @param image - image to draw, null image to remove buffer.
+	/// @param segment - shared memory segment that holds image pixels, it is locked while painting. May be nullptr.
+	void setPixelBuffer(QImage const &image, QSharedMemory *segment = nullptr);
+
 private:
 	/// Information about point.
 	struct PointCoordinates
@@ -201,6 +209,12 @@ private:
 
 	/// Current pen width.
 	int mCurrentPenWidth;
+
+	/// Raw pixel buffer drawn under all other items.
+	QImage mPixelBuffer;
+
+	/// Shared memory segment that holds pixel buffer data. Does not have ownership.
+	QSharedMemory *mPixelBufferSegment;
 };
 
 }
@@ -27,6 +27,10 @@
 #include <QtCore/QThread>
 #include <QtGui/QPixmap>
 
+#include "displayMirror.h"
+
+#include "QsLog.h"
+
 using namespace trikControl;
 
 GuiWorker::GuiWorker()
@@ -34,6 +38,11 @@ GuiWorker::GuiWorker()
 
 }
 
+GuiWorker::~GuiWorker()
+{
+	releasePixelBuffers();
+}
+
 void GuiWorker::init()
 {
 	mImageLabel.reset(new QLabel());
@@ -58,7 +67,7 @@ void GuiWorker::showImage(QString const &fileName)
 	}
 
 	mImageLabel->setPixmap(mImagesCache.value(fileName));
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::addLabel(QString const &text, int x, int y)
@@ -77,7 +86,7 @@ void GuiWorker::addLabel(QString const &text, int x, int y)
 		mLabels.insertMulti(x ^ y, label);
 	}
 
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::removeLabels()
@@ -138,7 +147,7 @@ void GuiWorker::setBackground(QString const &color)
 	}
 
 	mImageWidget->setPalette(palette);
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::resetBackground()
@@ -163,15 +172,16 @@ void GuiWorker::clear()
 	mImageWidget->deleteAllItems();
 	mImageWidget->setPainterColor("black");
 	mImageWidget->setPainterWidth(1);
-	mImageWidget->hide();
+	hideWidget();
 	removeLabels();
 	mImageLabel->setPixmap(QPixmap());
+	releasePixelBuffers();
 	resetBackground();
 }
 
 void GuiWorker::hide()
 {
-	mImageWidget->hide();
+	hideWidget();
 }
 
 QLabel *GuiWorker::findLabel(int x, int y) const
@@ -189,33 +199,133 @@ void GuiWorker::drawPoint(int x, int y)
 {
 	mImageWidget->drawPoint(x, y);
 	mImageWidget->update();
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::drawLine(int x1, int y1, int x2, int y2)
 {
 	mImageWidget->drawLine(x1, y1, x2, y2);
 	mImageWidget->update();
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::drawRect(int x, int y, int width, int height)
 {
 	mImageWidget->drawRect(x, y, width, height);
 	mImageWidget->update();
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::drawEllipse(int x, int y, int width, int height)
 {
 	mImageWidget->drawEllipse(x, y, width, height);
 	mImageWidget->update();
-	mImageWidget->show();
+	showWidget();
 }
 
 void GuiWorker::drawArc(int x, int y, int width, int height, int startAngle, int spanAngle)
 {
 	mImageWidget->drawArc(x, y, width, height, startAngle, spanAngle);
 	mImageWidget->update();
+	showWidget();
+}
+
+void GuiWorker::drawBuffer(QByteArray const &data, int width, int height, int format)
+{
+	// QImage only refers to data here, pixels are not copied.
+	QImage const image(reinterpret_cast<uchar const *>(data.constData()), width, height
+			, static_cast<QImage::Format>(format));
+
+	if (showPixelBuffer(image, data.size())) {
+		mPixelBufferBytes = data;
+		mPixelBufferInts.clear();
+	}
+}
+
+void GuiWorker::drawBuffer(QVector<int> const &pixels, int width, int height)
+{
+	QImage const image(reinterpret_cast<uchar const *>(pixels.constData()), width, height, QImage::Format_RGB32);
+
+	if (showPixelBuffer(image, pixels.size() * static_cast<int>(sizeof(int)))) {
+		mPixelBufferInts = pixels;
+		mPixelBufferBytes.clear();
+	}
+}
+
+void GuiWorker::drawSharedBuffer(QString const &key, int width, int height, int format)
+{
+	QSharedMemory *segment = mSharedBuffers.value(key, nullptr);
+	if (!segment) {
+		segment = new QSharedMemory(key);
+		if (!segment->attach(QSharedMemory::ReadOnly)) {
+			QLOG_ERROR() << "Failed to attach to shared memory segment" << key << ":" << segment->errorString();
+			qDebug() << "Failed to attach to shared memory segment" << key << ":" << segment->errorString();
+			delete segment;
+			return;
+		}
+
+		mSharedBuffers.insert(key, segment);
+	}
+
+	QImage const image(static_cast<uchar const *>(segment->constData()), width, height
+			, static_cast<QImage::Format>(format));
+
+	if (showPixelBuffer(image, segment->size(), segment)) {
+		mPixelBufferBytes.clear();
+		mPixelBufferInts.clear();
+	}
+}
+
+bool GuiWorker::showPixelBuffer(QImage const &image, int availableBytes, QSharedMemory *segment)
+{
+	if (image.isNull() || image.byteCount() > availableBytes) {
+		QLOG_ERROR() << "Pixel buffer of" << availableBytes << "bytes does not match image" << image.size()
+				<< "in format" << image.format();
+		qDebug() << "Pixel buffer of" << availableBytes << "bytes does not match image" << image.size()
+				<< "in format" << image.format();
+		return false;
+	}
+
+	mImageWidget->setPixelBuffer(image, segment);
+	mImageWidget->update();
+	showWidget();
+	return true;
+}
+
+void GuiWorker::releasePixelBuffers()
+{
+	if (mImageWidget) {
+		mImageWidget->setPixelBuffer(QImage());
+	}
+
+	mPixelBufferBytes.clear();
+	mPixelBufferInts.clear();
+
+	for (QSharedMemory * const segment : mSharedBuffers.values()) {
+		segment->detach();
+	}
+
+	qDeleteAll(mSharedBuffers);
+	mSharedBuffers.clear();
+}
+
+void GuiWorker::startMirroring(int port, int maxFps, int tileSize)
+{
+	mMirror.reset(new DisplayMirror(*mImageWidget, port, maxFps, tileSize));
+}
+
+void GuiWorker::showWidget()
+{
 	mImageWidget->show();
+	if (mMirror) {
+		mMirror->markDirty();
+	}
+}
+
+void GuiWorker::hideWidget()
+{
+	mImageWidget->hide();
+	if (mMirror) {
+		mMirror->markDirty();
+	}
 }
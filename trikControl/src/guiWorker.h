@@ -18,7 +18,10 @@
 #include <QtCore/QMultiHash>
 #include <QtCore/QList>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QSharedMemory>
+#include <QtCore/QVector>
 #include <QtGui/QPixmap>
+#include <QtGui/QImage>
 #include <QtGui/QFontMetrics>
 
 #include "graphicsWidget.h"
@@ -33,6 +36,8 @@
 
 namespace trikControl {
 
+class DisplayMirror;
+
 /// Works in GUI thread and is responsible for all output to display.
 class GuiWorker : public QObject
 {
@@ -41,6 +46,8 @@ class GuiWorker : public QObject
 public:
 	GuiWorker();
 
+	~GuiWorker() override;
+
 public slots:
 	/// Shows image with given filename on display. Image is scaled to fill the screen and is cached on first read
 	/// for better performance.
@@ -110,20 +117,76 @@ public slots:
 	/// @param spanAngle - end andle.
 	void drawArc(int x, int y, int width, int height, int startAngle, int spanAngle);
 
+	/// Shows raw pixel buffer on a display without copying it. Buffer is kept until it is replaced or display is
+	/// cleared.
+	/// @param data - pixel data, lines shall be 32-bit aligned.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	/// @param format - QImage::Format of pixel data.
+	void drawBuffer(QByteArray const &data, int width, int height, int format);
+
+	/// Shows array of pixels in 0xRRGGBB format without copying it.
+	/// @param pixels - pixel data.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	void drawBuffer(QVector<int> const &pixels, int width, int height);
+
+	/// Shows contents of shared memory segment with given key. Segment is attached on first use and stays attached
+	/// until display is cleared.
+	/// @param key - key of QSharedMemory segment.
+	/// @param width - width of an image in pixels.
+	/// @param height - height of an image in pixels.
+	/// @param format - QImage::Format of pixel data.
+	void drawSharedBuffer(QString const &key, int width, int height, int format);
+
+	/// Starts streaming display contents to TCP clients.
+	/// @param port - TCP port to listen for clients.
+	/// @param maxFps - maximal number of frames per second to send.
+	/// @param tileSize - size of a side of a tile in pixels, only changed tiles are sent.
+	void startMirroring(int port, int maxFps, int tileSize);
+
 	/// Initializes widget. Shall be called when widget is moved to correct thread. Not supposed to be called from .qts.
 	void init();
 
 private:
 	void resetBackground();
 
+	/// Shows image widget and notifies mirror, if any, that display contents has changed.
+	void showWidget();
+
+	/// Hides image widget and notifies mirror, if any, that display contents has changed.
+	void hideWidget();
+
 	/// Returns existing label with given coordinates or nullptr if no such label exists.
 	QLabel *findLabel(int x, int y) const;
 
+	/// Shows given image, which refers to pixel data owned by someone else, or reports an error if image is invalid.
+	/// @param image - image to show.
+	/// @param availableBytes - size of pixel data actually available.
+	/// @param segment - shared memory segment that holds pixel data, or nullptr.
+	/// @returns true if image is shown.
+	bool showPixelBuffer(QImage const &image, int availableBytes, QSharedMemory *segment = nullptr);
+
+	/// Detaches from all shared memory segments and forgets pixel buffers.
+	void releasePixelBuffers();
+
 	QScopedPointer<GraphicsWidget> mImageWidget;
 	QScopedPointer<QLabel> mImageLabel;
 	QHash<QString, QPixmap> mImagesCache;
 	QMultiHash<int, QLabel *> mLabels; // Has ownership.
 	QScopedPointer<QFontMetrics> mFontMetrics;
+
+	/// Pixel data of currently shown raw buffer, held here to keep it alive while it is drawn.
+	QByteArray mPixelBufferBytes;
+
+	/// Pixel data of currently shown raw buffer, if it came from a script as an array of ints.
+	QVector<int> mPixelBufferInts;
+
+	/// Attached shared memory segments, by key.
+	QHash<QString, QSharedMemory *> mSharedBuffers;  // Has ownership.
+
+	/// Streams display contents to remote clients, if mirroring is enabled.
+	QScopedPointer<DisplayMirror> mMirror;
 };
 
 }
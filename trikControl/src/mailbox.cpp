@@ -3,14 +3,20 @@
 #include "src/mailboxServer.h"
 
 #include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+
+#include <trikKernel/monotonicClock.h>
 
 using namespace trikControl;
 
-Mailbox::Mailbox(int port)
-	: mWorker(new MailboxServer(port))
+Mailbox::Mailbox(int port, QString const &multicastGroup, int multicastPort)
+	: mWorker(new MailboxServer(port, multicastGroup, multicastPort))
 {
 	QObject::connect(mWorker.data(), SIGNAL(newMessage(int, QString)), this, SIGNAL(newMessage(int, QString)));
-	QObject::connect(mWorker.data(), SIGNAL(newMessage(int, QString)), this, SIGNAL(stopWaiting()));
+	QObject::connect(mWorker.data(), SIGNAL(newValue(int, QVariant)), this, SIGNAL(newValue(int, QVariant)));
+	QObject::connect(mWorker.data(), SIGNAL(fileReceived(int, QString)), this, SIGNAL(fileReceived(int, QString)));
+	QObject::connect(this, SIGNAL(stopWaiting()), this, SLOT(abortWaiting()), Qt::DirectConnection);
 
 	mWorker->moveToThread(&mWorkerThread);
 	mWorkerThread.start();
@@ -62,24 +68,142 @@ void Mailbox::send(QString const &message)
 	QMetaObject::invokeMethod(mWorker.data(), "send", Q_ARG(QString const &, message));
 }
 
+void Mailbox::sendValue(int hullNumber, QVariant const &value)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "sendValue", Q_ARG(int, hullNumber), Q_ARG(QVariant const &, value));
+}
+
+void Mailbox::sendValue(QVariant const &value)
+{
+	sendValue(-1, value);
+}
+
+void Mailbox::sendFile(int hullNumber, QString const &path)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "sendFile", Q_ARG(int, hullNumber), Q_ARG(QString const &, path));
+}
+
+void Mailbox::sendBlob(int hullNumber, QString const &name, QByteArray const &data)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "sendBlob"
+			, Q_ARG(int, hullNumber)
+			, Q_ARG(QString const &, name)
+			, Q_ARG(QByteArray const &, data)
+			);
+}
+
+void Mailbox::setQueueLimit(int maxSize, bool backpressure)
+{
+	mWorker->setQueueLimit(maxSize, backpressure);
+}
+
+void Mailbox::setBatchWindow(int batchWindowMs)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "setBatchWindow", Q_ARG(int, batchWindowMs));
+}
+
+void Mailbox::setBinaryFraming(bool enabled, bool compress)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "setBinaryFraming", Q_ARG(bool, enabled), Q_ARG(bool, compress));
+}
+
+void Mailbox::setMaxReceivedFileSize(qint64 bytes)
+{
+	QMetaObject::invokeMethod(mWorker.data(), "setMaxReceivedFileSize", Q_ARG(qint64, bytes));
+}
+
+QVariantMap Mailbox::linkStatistics() const
+{
+	// Connections live in a worker thread, so asking it to collect statistics and waiting for a result.
+	QVariantMap result;
+	QMetaObject::invokeMethod(mWorker.data(), "linkStatistics", Qt::BlockingQueuedConnection
+			, Q_RETURN_ARG(QVariantMap, result));
+
+	return result;
+}
+
+QVariantMap Mailbox::peerStatistics() const
+{
+	QVariantMap result;
+	QMetaObject::invokeMethod(mWorker.data(), "peerStatistics", Qt::BlockingQueuedConnection
+			, Q_RETURN_ARG(QVariantMap, result));
+
+	return result;
+}
+
+int Mailbox::lastMessageAge() const
+{
+	if (mLastMessageSendTime == -1) {
+		return -1;
+	}
+
+	return static_cast<int>((trikKernel::MonotonicClock::microseconds() - mLastMessageSendTime) / 1000);
+}
+
 bool Mailbox::hasMessages()
 {
 	return mWorker->hasMessages();
 }
 
+bool Mailbox::hasMessages(int hullNumber)
+{
+	return mWorker->hasMessages(hullNumber);
+}
+
 QString Mailbox::receive()
 {
-	QString result;
+	return receive(-1);
+}
+
+QString Mailbox::receive(int hullNumber, int timeoutMs)
+{
+	return receiveValue(hullNumber, timeoutMs).toString();
+}
+
+QVariant Mailbox::receiveValue(int hullNumber, int timeoutMs)
+{
+	mLastMessageSendTime = -1;
+	return waitForMessage(hullNumber, timeoutMs)
+			? mWorker->receiveValue(hullNumber, mLastMessageSendTime)
+			: QVariant();
+}
+
+void Mailbox::abortWaiting()
+{
+	mWaitAborted.fetchAndStoreOrdered(1);
+}
+
+bool Mailbox::waitForMessage(int hullNumber, int timeoutMs)
+{
+	mWaitAborted.fetchAndStoreOrdered(0);
 
 	QEventLoop loop;
+	QTimer timeoutTimer;
+	timeoutTimer.setSingleShot(true);
+	QObject::connect(&timeoutTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
+	QObject::connect(mWorker.data(), SIGNAL(messageEnqueued(int)), &loop, SLOT(quit()));
 	QObject::connect(this, SIGNAL(stopWaiting()), &loop, SLOT(quit()));
-	if (!mWorker->hasMessages()) {
-		loop.exec();
-	}
 
-	if (mWorker->hasMessages()) {
-		result = mWorker->receive();
+	QElapsedTimer elapsed;
+	elapsed.start();
+
+	// Loop is woken up by a message from any robot, so checking again if it is the one we are waiting for.
+	while (!mWorker->hasMessages(hullNumber)) {
+		if (mWaitAborted.testAndSetOrdered(1, 0)) {
+			return false;
+		}
+
+		if (timeoutMs >= 0) {
+			qint64 const remaining = timeoutMs - elapsed.elapsed();
+			if (remaining <= 0) {
+				return false;
+			}
+
+			timeoutTimer.start(static_cast<int>(remaining));
+		}
+
+		loop.exec();
 	}
 
-	return result;
+	return true;
 }
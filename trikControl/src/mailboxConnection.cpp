@@ -1,24 +1,282 @@
 #include "src/mailboxConnection.h"
 
 #include <QtCore/QStringList>
+#include <QtCore/QDataStream>
+#include <QtCore/QBuffer>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 
 #include <QtCore/QDebug>
 
+#include <trikKernel/monotonicClock.h>
+
 #include "QsLog.h"
 
 using namespace trikControl;
 
+/// Advertises that this runtime understands "ts:" timestamps of messages and "ping"/"pong" commands.
+QByteArray const clockFeatureCommand = "features:clock";
+
+/// Size of one chunk of a transferred file.
+int const transferChunkSize = 16 * 1024;
+
+/// Chunks are not sent while there is more than this number of bytes not yet written to a network.
+qint64 const maxUnsentTransferBytes = 64 * 1024;
+
+/// Directory for received files.
+QString const receivedFilesDir = QDir::tempPath() + "/trikMailbox";
+
 MailboxConnection::MailboxConnection()
 	: trikKernel::Connection(trikKernel::Protocol::messageLength)
 {
 }
 
+MailboxConnection::~MailboxConnection()
+{
+	for (int const id : mIncomingTransfers.keys()) {
+		abortIncomingTransfer(id);
+	}
+}
+
 void MailboxConnection::connect(const QHostAddress &targetIp, int targetPort, int myServerPort, int myHullNumber)
 {
+	mMyServerPort = myServerPort;
+	mMyHullNumber = myHullNumber;
 	init(targetIp, targetPort);
+}
 
-	QString const handshake = QString("register:%1:%2").arg(myServerPort).arg(myHullNumber);
+void MailboxConnection::setMyHullNumber(int hullNumber)
+{
+	mMyHullNumber = hullNumber;
+}
+
+void MailboxConnection::setMaxReceivedFileSize(qint64 bytes)
+{
+	mMaxReceivedFileSize = bytes;
+}
+
+void MailboxConnection::onEstablished()
+{
+	QString const handshake = QString("register:%1:%2").arg(mMyServerPort).arg(mMyHullNumber);
 	send(handshake.toUtf8());
+
+	// Advertising timestamps and pings in a separate command, since older runtimes reject "register" with extra
+	// fields. They just log this one as malformed. Peer may be a different runtime after reconnection.
+	mPeerSupportsClock = false;
+	mClockSupportAdvertised = true;
+	send(clockFeatureCommand);
+
+	// Connection was reestablished, so receiver lost a transfer that was in progress, restarting it from the beginning.
+	if (!mOutgoingTransfers.isEmpty() && mOutgoingTransfers.first()->started) {
+		auto const &transfer = mOutgoingTransfers.first();
+		transfer->device->seek(0);
+		transfer->hash.reset();
+		transfer->started = false;
+	}
+
+	pumpTransfers();
+}
+
+void MailboxConnection::onBytesWritten()
+{
+	pumpTransfers();
+}
+
+void MailboxConnection::sendFile(QString const &path)
+{
+	QFile * const file = new QFile(path);
+	if (!file->open(QIODevice::ReadOnly)) {
+		QLOG_ERROR() << "Can not open file" << path << "for sending";
+		qDebug() << "Can not open file" << path << "for sending";
+		delete file;
+		return;
+	}
+
+	startTransfer(file, QFileInfo(path).fileName());
+}
+
+void MailboxConnection::sendBlob(QString const &name, QByteArray const &data)
+{
+	QBuffer * const buffer = new QBuffer();
+	buffer->setData(data);
+	buffer->open(QIODevice::ReadOnly);
+	startTransfer(buffer, name);
+}
+
+void MailboxConnection::startTransfer(QIODevice *device, QString const &name)
+{
+	QSharedPointer<OutgoingTransfer> transfer(new OutgoingTransfer());
+	transfer->id = mNextTransferId++;
+	transfer->device.reset(device);
+	transfer->name = name;
+	mOutgoingTransfers.append(transfer);
+
+	pumpTransfers();
+}
+
+void MailboxConnection::pumpTransfers()
+{
+	while (!mOutgoingTransfers.isEmpty() && isConnected() && bytesToWrite() < maxUnsentTransferBytes) {
+		auto const &transfer = mOutgoingTransfers.first();
+		QByteArray const id = QByteArray::number(transfer->id);
+		if (!transfer->started) {
+			transfer->started = true;
+			send("file:" + id + ':' + QByteArray::number(transfer->device->size()) + ':' + transfer->name.toUtf8());
+		}
+
+		QByteArray const chunk = transfer->device->read(transferChunkSize);
+		if (chunk.isEmpty() && !transfer->device->atEnd()) {
+			// Read error. Nothing would be sent, so the loop would never end. Empty hash makes a receiver discard
+			// what it got so far.
+			QLOG_ERROR() << "Failed to read" << transfer->name << "for sending:" << transfer->device->errorString();
+			qDebug() << "Failed to read" << transfer->name << "for sending:" << transfer->device->errorString();
+			send("end:" + id + ':');
+			mOutgoingTransfers.removeFirst();
+			continue;
+		}
+
+		if (!chunk.isEmpty()) {
+			transfer->hash.addData(chunk);
+			send("chunk:" + id + ':' + chunk);
+		}
+
+		if (transfer->device->atEnd()) {
+			send("end:" + id + ':' + transfer->hash.result().toHex());
+			mOutgoingTransfers.removeFirst();
+		}
+	}
+}
+
+bool MailboxConnection::processTransferCommand(QByteArray const &data)
+{
+	if (data.startsWith("chunk:")) {
+		int const idEnd = data.indexOf(':', 6);
+		int const id = data.mid(6, idEnd - 6).toInt();
+		auto const transfer = mIncomingTransfers.value(id);
+		if (idEnd != -1 && mRejectedTransfers.contains(id)) {
+			return true;
+		}
+
+		if (idEnd == -1 || !transfer) {
+			QLOG_ERROR() << "Chunk of unknown transfer received, ignoring";
+			qDebug() << "Chunk of unknown transfer received, ignoring";
+			return true;
+		}
+
+		char const * const chunk = data.constData() + idEnd + 1;
+		int const chunkSize = data.size() - idEnd - 1;
+		transfer->hash.addData(chunk, chunkSize);
+		if (transfer->file.write(chunk, chunkSize) != chunkSize
+				|| transfer->file.size() > transfer->size)
+		{
+			QLOG_ERROR() << "Failed to write received file" << transfer->file.fileName();
+			qDebug() << "Failed to write received file" << transfer->file.fileName();
+			abortIncomingTransfer(id);
+		}
+
+		return true;
+	}
+
+	if (data.startsWith("file:")) {
+		QList<QByteArray> const parts = data.split(':');
+		if (parts.size() < 4) {
+			return false;
+		}
+
+		int const id = parts[1].toInt();
+		abortIncomingTransfer(id);
+		mRejectedTransfers.remove(id);
+
+		// Name can contain ':', and also shall not contain a path, or a sender would be able to write anywhere.
+		QString const name = QFileInfo(QString::fromUtf8(data.mid(parts[0].size() + parts[1].size()
+				+ parts[2].size() + 3))).fileName();
+
+		bool sizeOk = false;
+		qint64 const size = parts[2].toLongLong(&sizeOk);
+		if (!sizeOk || size < 0 || (mMaxReceivedFileSize > 0 && size > mMaxReceivedFileSize)) {
+			QLOG_ERROR() << "Rejecting received file" << name << "of size" << parts[2] << ", limit is"
+					<< mMaxReceivedFileSize;
+			qDebug() << "Rejecting received file" << name << "of size" << parts[2] << ", limit is"
+					<< mMaxReceivedFileSize;
+			mRejectedTransfers.insert(id);
+			return true;
+		}
+
+		QDir().mkpath(receivedFilesDir);
+
+		QSharedPointer<IncomingTransfer> transfer(new IncomingTransfer());
+		transfer->size = size;
+		transfer->path = uniqueReceivedFilePath(name.isEmpty() ? QString("file") : name);
+		transfer->file.setFileName(transfer->path + ".part");
+		if (!transfer->file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			QLOG_ERROR() << "Can not open file" << transfer->file.fileName() << "to receive a file";
+			qDebug() << "Can not open file" << transfer->file.fileName() << "to receive a file";
+			return true;
+		}
+
+		mIncomingTransfers.insert(id, transfer);
+		return true;
+	}
+
+	if (data.startsWith("end:")) {
+		QList<QByteArray> const parts = data.split(':');
+		if (parts.size() != 3) {
+			return false;
+		}
+
+		int const id = parts[1].toInt();
+		mRejectedTransfers.remove(id);
+		auto const transfer = mIncomingTransfers.value(id);
+		if (!transfer) {
+			return true;
+		}
+
+		transfer->file.close();
+		if (transfer->file.size() != transfer->size || transfer->hash.result().toHex() != parts[2]) {
+			QLOG_ERROR() << "Received file" << transfer->path << "is corrupted, discarding it";
+			qDebug() << "Received file" << transfer->path << "is corrupted, discarding it";
+			abortIncomingTransfer(id);
+			return true;
+		}
+
+		if (!transfer->file.rename(transfer->path)) {
+			QLOG_ERROR() << "Can not rename received file to" << transfer->path;
+			qDebug() << "Can not rename received file to" << transfer->path;
+			abortIncomingTransfer(id);
+			return true;
+		}
+
+		mIncomingTransfers.remove(id);
+		emit fileReceived(peerAddress(), peerPort(), transfer->path);
+		return true;
+	}
+
+	return false;
+}
+
+void MailboxConnection::abortIncomingTransfer(int id)
+{
+	auto const transfer = mIncomingTransfers.take(id);
+	if (transfer) {
+		transfer->file.close();
+		transfer->file.remove();
+	}
+}
+
+QString MailboxConnection::uniqueReceivedFilePath(QString const &name)
+{
+	// Files being received are also taken into account, by their ".part" files.
+	QFileInfo const nameInfo(name);
+	QString result = receivedFilesDir + "/" + name;
+	for (int number = 1; QFile::exists(result) || QFile::exists(result + ".part"); ++number) {
+		QString const numberedName = nameInfo.suffix().isEmpty()
+				? QString("%1-%2").arg(name).arg(number)
+				: QString("%1-%2.%3").arg(nameInfo.completeBaseName()).arg(number).arg(nameInfo.suffix());
+
+		result = receivedFilesDir + "/" + numberedName;
+	}
+
+	return result;
 }
 
 void MailboxConnection::sendConnectionInfo(QHostAddress const &ip, int port, int hullNumber)
@@ -33,13 +291,147 @@ void MailboxConnection::sendSelfInfo(int hullNumber)
 	send(info.toUtf8());
 }
 
+bool MailboxConnection::peerSupportsClock() const
+{
+	return mPeerSupportsClock;
+}
+
+void MailboxConnection::ping()
+{
+	// Older runtimes do not know "ping" and would log every one of them as malformed data.
+	if (!mPeerSupportsClock) {
+		return;
+	}
+
+	send("ping:" + QByteArray::number(trikKernel::MonotonicClock::microseconds()));
+
+	// Time of ping shall not include batching delay.
+	flush();
+}
+
+bool MailboxConnection::processClockCommand(QByteArray const &data)
+{
+	if (data == clockFeatureCommand) {
+		mPeerSupportsClock = true;
+
+		// Answering an advertisement of a peer that connected to us.
+		if (!mClockSupportAdvertised) {
+			mClockSupportAdvertised = true;
+			send(clockFeatureCommand);
+		}
+
+		return true;
+	}
+
+	if (data.startsWith("ping:")) {
+		// Echoing sender time and adding ours.
+		send("pong:" + data.mid(5) + ':' + QByteArray::number(trikKernel::MonotonicClock::microseconds()));
+		flush();
+		return true;
+	}
+
+	if (data.startsWith("pong:")) {
+		qint64 const receiveTime = trikKernel::MonotonicClock::microseconds();
+		QList<QByteArray> const parts = data.split(':');
+		bool sendTimeOk = false;
+		bool peerTimeOk = false;
+		qint64 const sendTime = parts.size() == 3 ? parts[1].toLongLong(&sendTimeOk) : 0;
+		qint64 const peerTime = parts.size() == 3 ? parts[2].toLongLong(&peerTimeOk) : 0;
+		if (!sendTimeOk || !peerTimeOk || sendTime > receiveTime) {
+			return false;
+		}
+
+		qint64 const roundTripTime = receiveTime - sendTime;
+		emit clockSample(peerAddress(), peerPort(), roundTripTime, peerTime - sendTime - roundTripTime / 2);
+		return true;
+	}
+
+	return false;
+}
+
+QByteArray MailboxConnection::encodeMessage(QVariant const &message)
+{
+	if (message.type() == QVariant::String) {
+		return "data:" + message.toString().toUtf8();
+	}
+
+	if (message.type() == QVariant::ByteArray) {
+		return "bin:" + message.toByteArray();
+	}
+
+	QByteArray result = "var:";
+	QDataStream stream(&result, QIODevice::WriteOnly | QIODevice::Append);
+
+	// Fixed version allows robots with Qt 4 and Qt 5 runtimes to talk to each other.
+	stream.setVersion(QDataStream::Qt_4_8);
+	stream << message;
+	return result;
+}
+
+QByteArray MailboxConnection::timestamped(QByteArray const &encodedMessage)
+{
+	return "ts:" + QByteArray::number(trikKernel::MonotonicClock::microseconds()) + ':' + encodedMessage;
+}
+
+bool MailboxConnection::decodeMessage(QByteArray const &rawData, QVariant &message, qint64 &senderTime)
+{
+	senderTime = -1;
+	int offset = 0;
+	if (rawData.startsWith("ts:")) {
+		int const timestampEnd = rawData.indexOf(':', 3);
+		bool ok = false;
+		senderTime = rawData.mid(3, timestampEnd - 3).toLongLong(&ok);
+		if (timestampEnd == -1 || !ok) {
+			return false;
+		}
+
+		offset = timestampEnd + 1;
+	}
+
+	// Looking at a message behind a timestamp without copying it.
+	QByteArray const data = QByteArray::fromRawData(rawData.constData() + offset, rawData.size() - offset);
+
+	if (data.startsWith("data:")) {
+		int const prefixLength = 5;
+		message = QString::fromUtf8(data.constData() + prefixLength, data.size() - prefixLength);
+		return true;
+	}
+
+	if (data.startsWith("bin:")) {
+		int const prefixLength = 4;
+		message = QByteArray(data.constData() + prefixLength, data.size() - prefixLength);
+		return true;
+	}
+
+	if (data.startsWith("var:")) {
+		QDataStream stream(data);
+		stream.setVersion(QDataStream::Qt_4_8);
+		stream.skipRawData(4);
+		stream >> message;
+		return stream.status() == QDataStream::Ok;
+	}
+
+	return false;
+}
+
 void MailboxConnection::processData(QByteArray const &rawData)
 {
-	QString const data = QString::fromUtf8(rawData);
+	// Messages are checked first and decoded directly from raw bytes, without conversion to QString.
+	QVariant message;
+	qint64 senderTime = -1;
+	if (decodeMessage(rawData, message, senderTime)) {
+		emit newData(peerAddress(), peerPort(), message, senderTime);
+		return;
+	}
+
+	if (processTransferCommand(rawData) || processClockCommand(rawData)) {
+		return;
+	}
+
+	QString const data = QString::fromUtf8(rawData.constData(), rawData.size());
 	QString const registerCommand = "register:";
 	QString const connectionCommand = "connection:";
 	QString const selfCommand = "self:";
-	QString const dataCommand = "data:";
 	auto const error = [](QString const &data) {
 			QLOG_ERROR() << "Malformed data: " << data;
 			qDebug() << "Malformed data: " << data;
@@ -89,9 +481,7 @@ void MailboxConnection::processData(QByteArray const &rawData)
 				emit connectionInfo(peerAddress(), peerPort(), hullNumber);
 			}
 		}
-	} else if (data.startsWith(dataCommand)) {
-		QString parsedString = data;
-		parsedString.remove(0, dataCommand.length());
-		emit newData(peerAddress(), peerPort(), parsedString.toUtf8());
+	} else {
+		error(data);
 	}
 }
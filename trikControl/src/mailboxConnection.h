@@ -16,27 +16,79 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QVariant>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
 #include <QtNetwork/QTcpSocket>
 #include <trikKernel/connection.h>
 
 namespace trikControl {
 
-/// One connection to a client (or server) in mailbox. Supposed to be working in a separate thread.
+/// One connection to a client (or server) in mailbox. Works in a thread of mailbox server.
 class MailboxConnection : public trikKernel::Connection {
 	Q_OBJECT
 
 public:
+	/// Default maximal size of a received file in bytes.
+	static qint64 const defaultMaxReceivedFileSize = 16 * 1024 * 1024;
+
 	MailboxConnection();
 
-	/// Connect to given endpoint and send "register" command with our mailbox server port and hull number.
+	/// Removes partially received files.
+	~MailboxConnection() override;
+
+	/// Connect to given endpoint and send "register" command with our mailbox server port and hull number. Returns
+	/// immediately, "register" is sent again every time connection is reestablished.
 	Q_INVOKABLE void connect(QHostAddress const &targetIp, int targetPort, int myServerPort, int myHullNumber);
 
+	/// Updates our hull number to be sent in "register" command on reconnection.
+	Q_INVOKABLE void setMyHullNumber(int hullNumber);
+
 	/// Send info about other robot: its IP, port and hull number.
 	Q_INVOKABLE void sendConnectionInfo(QHostAddress const &ip, int port, int hullNumber);
 
 	/// Send our hull number. Used in response for connection request.
 	Q_INVOKABLE void sendSelfInfo(int hullNumber);
 
+	/// Starts sending a file. Returns immediately, file is read and sent by chunks as fast as the network allows,
+	/// so it is never loaded into memory as a whole. Transfers are sent one by one, other messages are interleaved
+	/// with chunks.
+	/// @param path - path to a file to send.
+	Q_INVOKABLE void sendFile(QString const &path);
+
+	/// Starts sending in-memory data, receiver gets it as a file with given name.
+	Q_INVOKABLE void sendBlob(QString const &name, QByteArray const &data);
+
+	/// Sets maximal size of a received file, larger files are rejected, so a peer can not fill a temporary
+	/// directory.
+	/// @param bytes - maximal file size in bytes, 0 means unlimited.
+	void setMaxReceivedFileSize(qint64 bytes);
+
+	/// Sends "ping" command with current time, peer answers with "pong" command and clockSample() is emitted.
+	/// Does nothing if a peer has not advertised that it supports pings.
+	Q_INVOKABLE void ping();
+
+	/// Returns true if a peer has advertised (by "features:clock" command) that it understands pings and
+	/// timestamped messages. Older runtimes do not, they accept only messages without timestamp.
+	bool peerSupportsClock() const;
+
+	/// Encodes message for sending: strings are sent as "data:<UTF-8 text>", byte arrays as "bin:<raw bytes>",
+	/// all other values as "var:<QVariant serialized by QDataStream>".
+	static QByteArray encodeMessage(QVariant const &message);
+
+	/// Prefixes encoded message by "ts:<sender monotonic time in microseconds>:", for peers that support it.
+	static QByteArray timestamped(QByteArray const &encodedMessage);
+
+	/// Decodes message encoded by encodeMessage(). Returns false if data is not a message (it may be a control
+	/// command) or is malformed.
+	/// @param senderTime - sender monotonic time in microseconds when message was sent, or -1 if message has no
+	///        timestamp.
+	static bool decodeMessage(QByteArray const &data, QVariant &message, qint64 &senderTime);
+
 signals:
 	/// Emitted when "register" command is received.
 	/// @param ip - remote robot IP.
@@ -48,11 +100,92 @@ signals:
 	/// Emitted when remote robot sends info about other known robots ("connection" command).
 	void connectionInfo(QHostAddress const &ip, int port, int hullNumber);
 
-	/// Emitted when new data message received ("data" command).
-	void newData(QHostAddress const &ip, int port, QByteArray const &data);
+	/// Emitted when new message received ("data", "bin" or "var" command).
+	/// @param senderTime - sender monotonic time in microseconds when message was sent, or -1 if it is unknown.
+	void newData(QHostAddress const &ip, int port, QVariant const &data, qint64 senderTime);
+
+	/// Emitted when answer for ping() is received.
+	/// @param roundTripTime - time from sending "ping" to receiving "pong" in microseconds.
+	/// @param clockOffset - estimated difference between monotonic clock of a peer and ours in microseconds,
+	///        assuming that network delay is the same in both directions.
+	void clockSample(QHostAddress const &ip, int port, qint64 roundTripTime, qint64 clockOffset);
+
+	/// Emitted when a file is completely received and its checksum is verified.
+	/// @param path - full path to a received file.
+	void fileReceived(QHostAddress const &ip, int port, QString const &path);
 
 private:
+	/// File being sent, "file:<id>:<size>:<name>" command, then "chunk:<id>:<data>" commands, then
+	/// "end:<id>:<SHA-1 of contents in hex>" command are sent for each transfer.
+	struct OutgoingTransfer {
+		OutgoingTransfer() : hash(QCryptographicHash::Sha1) {}
+
+		int id = 0;
+		QScopedPointer<QIODevice> device;
+		QString name;
+		QCryptographicHash hash;
+		bool started = false;
+	};
+
+	/// File being received. Data is written to "<name>.part" file which is renamed when transfer is complete.
+	struct IncomingTransfer {
+		IncomingTransfer() : hash(QCryptographicHash::Sha1) {}
+
+		QFile file;
+		QString path;
+		qint64 size = 0;
+		QCryptographicHash hash;
+	};
+
 	void processData(QByteArray const &data) override;
+
+	void onEstablished() override;
+
+	void onBytesWritten() override;
+
+	/// Adds new transfer to a queue.
+	void startTransfer(QIODevice *device, QString const &name);
+
+	/// Sends chunks of queued transfers while there is not too much unsent data.
+	void pumpTransfers();
+
+	/// Processes "features", "ping" and "pong" commands, returns false if data is not one of them.
+	bool processClockCommand(QByteArray const &data);
+
+	/// Processes "file", "chunk" and "end" commands, returns false if data is not one of them.
+	bool processTransferCommand(QByteArray const &data);
+
+	/// Drops incoming transfer and removes its partially received file.
+	void abortIncomingTransfer(int id);
+
+	/// Returns path for a received file with given name that is not used by other received files, adding a number
+	/// to a name if needed.
+	static QString uniqueReceivedFilePath(QString const &name);
+
+	/// Transfers waiting to be sent, the first one is being sent.
+	QList<QSharedPointer<OutgoingTransfer>> mOutgoingTransfers;
+
+	/// Transfers being received by their ids.
+	QHash<int, QSharedPointer<IncomingTransfer>> mIncomingTransfers;
+
+	/// Ids of incoming transfers that were rejected, their chunks are dropped.
+	QSet<int> mRejectedTransfers;
+
+	/// Maximal size of a received file in bytes, 0 if unlimited.
+	qint64 mMaxReceivedFileSize = defaultMaxReceivedFileSize;
+
+	/// Id for the next outgoing transfer.
+	int mNextTransferId = 0;
+
+	/// Our mailbox server port and hull number, for "register" command.
+	int mMyServerPort = 0;
+	int mMyHullNumber = 0;
+
+	/// True if a peer advertised support of timestamps and pings.
+	bool mPeerSupportsClock = false;
+
+	/// True if we advertised support of timestamps and pings to a peer.
+	bool mClockSupportAdvertised = false;
 };
 
 }
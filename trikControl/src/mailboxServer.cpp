@@ -5,15 +5,42 @@
 #include <QtNetwork/QNetworkInterface>
 #include <QtCore/QSettings>
 
+#include <limits>
+
+#include <trikKernel/monotonicClock.h>
+
 #include "QsLog.h"
 
 using namespace trikControl;
 
-MailboxServer::MailboxServer(int port)
+/// Interval between announces of this robot to multicast group.
+int const announceIntervalMs = 5000;
+
+/// Robot is considered to receive multicast datagrams if its datagram was received within this time. Broadcasts to
+/// other robots are sent over TCP.
+qint64 const multicastPeerTimeoutMs = 3 * announceIntervalMs;
+
+/// Interval between pings of connected robots.
+int const pingIntervalMs = 1000;
+
+/// Number of recent ping samples used to estimate clock offset.
+int const clockSamplesWindow = 8;
+
+/// Maximal size of a broadcast datagram. Larger messages are sent over TCP, to avoid IP fragmentation.
+int const maxDatagramSize = 1400;
+
+/// Key of a message queue for robots whose hull number is not known yet. Hull number -1 can not be used for that,
+/// since it means "any robot" for receive().
+int const unknownSenderQueue = std::numeric_limits<int>::min();
+
+MailboxServer::MailboxServer(int port, QString const &multicastGroup, int multicastPort)
 	: trikKernel::TrikServer([this] () { return connectionFactory(); })
 	, mHullNumber(0)
 	, mMyIp(determineMyIp())
 	, mMyPort(port)
+	, mMulticastGroup(multicastGroup)
+	, mMulticastPort(multicastPort)
+	, mMaxReceivedFileSize(MailboxConnection::defaultMaxReceivedFileSize)
 {
 	qRegisterMetaType<QHostAddress>("QHostAddress");
 
@@ -24,11 +51,25 @@ MailboxServer::MailboxServer(int port)
 
 	loadSettings();
 
+	// All peer connections are multiplexed on one event loop of a mailbox thread, so number of threads does not
+	// grow with the number of robots in a network.
+	setConnectionThreadsCount(0);
+
 	startServer(port);
 
 	if (!mServerIp.isNull() && mServerIp != mMyIp) {
-		connect(mServerIp, mServerPort);
+		// Deferring connection until we are moved to a worker thread.
+		QMetaObject::invokeMethod(this, "connect", Qt::QueuedConnection
+				, Q_ARG(QString const &, mServerIp.toString())
+				, Q_ARG(int, mServerPort)
+				);
 	}
+
+	if (!mMulticastGroup.isNull()) {
+		QMetaObject::invokeMethod(this, "startMulticast", Qt::QueuedConnection);
+	}
+
+	QMetaObject::invokeMethod(this, "startPinging", Qt::QueuedConnection);
 }
 
 int MailboxServer::hullNumber() const
@@ -54,6 +95,14 @@ void MailboxServer::setHullNumber(int hullNumber)
 	mHullNumber = hullNumber;
 	saveSettings();
 
+	if (mMulticastSocket) {
+		announce();
+	}
+
+	for (auto const connectionObject : mOutgoingConnections.values()) {
+		connectionObject->setMyHullNumber(hullNumber);
+	}
+
 	forEveryConnection([this](trikKernel::Connection *connection) {
 		QMetaObject::invokeMethod(connection, "sendConnectionInfo"
 				, Q_ARG(QHostAddress const &, mMyIp)
@@ -100,10 +149,19 @@ void MailboxServer::connect(QString const &ip)
 
 trikKernel::Connection *MailboxServer::connect(QHostAddress const &ip, int port)
 {
+	// Connection to this endpoint may be already pending or reconnecting, reusing it then.
+	auto const existingConnection = mOutgoingConnections.value({ip, port}, nullptr);
+	if (existingConnection != nullptr) {
+		return existingConnection;
+	}
+
 	auto const connection = new MailboxConnection();
 
 	connectConnection(connection);
 
+	QObject::connect(connection, SIGNAL(disconnected()), this, SLOT(onOutgoingConnectionClosed()));
+	mOutgoingConnections.insert({ip, port}, connection);
+
 	startConnection(connection);
 
 	QMetaObject::invokeMethod(connection, "connect"
@@ -116,6 +174,13 @@ trikKernel::Connection *MailboxServer::connect(QHostAddress const &ip, int port)
 	return connection;
 }
 
+void MailboxServer::onOutgoingConnectionClosed()
+{
+	auto const connection = static_cast<MailboxConnection *>(sender());
+	auto const endpoint = mOutgoingConnections.key(connection, {QHostAddress(), 0});
+	mOutgoingConnections.remove(endpoint);
+}
+
 trikKernel::Connection *MailboxServer::connectionFactory()
 {
 	auto connection = new MailboxConnection();
@@ -130,11 +195,24 @@ trikKernel::Connection *MailboxServer::connectionFactory()
 
 void MailboxServer::connectConnection(trikKernel::Connection * connection)
 {
+	connection->setBatchWindow(mBatchWindowMs);
+	if (mBinaryFraming) {
+		connection->setBinaryFraming(true, mCompression);
+	}
+
+	static_cast<MailboxConnection *>(connection)->setMaxReceivedFileSize(mMaxReceivedFileSize);
+
 	QObject::connect(connection, SIGNAL(connectionInfo(QHostAddress, int, int))
 			, this, SLOT(onConnectionInfo(QHostAddress, int, int)));
 
-	QObject::connect(connection, SIGNAL(newData(QHostAddress, int, QByteArray const &))
-			, this, SLOT(onNewData(QHostAddress, int, QByteArray const &)));
+	QObject::connect(connection, SIGNAL(newData(QHostAddress, int, QVariant, qint64))
+			, this, SLOT(onNewData(QHostAddress, int, QVariant, qint64)));
+
+	QObject::connect(connection, SIGNAL(clockSample(QHostAddress, int, qint64, qint64))
+			, this, SLOT(onClockSample(QHostAddress, int, qint64, qint64)));
+
+	QObject::connect(connection, SIGNAL(fileReceived(QHostAddress, int, QString))
+			, this, SLOT(onFileReceived(QHostAddress, int, QString)));
 }
 
 QHostAddress MailboxServer::determineMyIp()
@@ -167,18 +245,12 @@ trikKernel::Connection *MailboxServer::prepareConnection(QHostAddress const &ip)
 	}
 
 	// Next, trying to create new connection to given IP. We need port, so checking if robot is known.
-	Endpoint targetEndpoint;
 	mKnownRobotsLock.lockForRead();
-	for (auto const &endpoint : mKnownRobots.values()) {
-		if (endpoint.ip == ip) {
-			targetEndpoint = endpoint;
-			break;
-		}
-	}
-
+	bool const isKnown = mEndpointsByIp.contains(ip);
+	Endpoint const targetEndpoint = isKnown ? mEndpointsByIp.value(ip) : Endpoint{QHostAddress(), 0};
 	mKnownRobotsLock.unlock();
 
-	if (targetEndpoint.ip.isNull()) {
+	if (!isKnown) {
 		QLOG_ERROR() << "Trying to connect to unknown robot, IP:" << ip;
 		qDebug() << "Trying to connect to unknown robot, IP:" << ip;
 		return nullptr;
@@ -195,12 +267,13 @@ void MailboxServer::onNewConnection(QHostAddress const &ip, int clientPort, int
 	}
 
 	mKnownRobotsLock.lockForRead();
-	bool const knownRobot = mKnownRobots.contains(hullNumber, {ip, serverPort});
-	auto const endpoints = mKnownRobots.values();
+	bool const knownRobot = knownHullNumber({ip, serverPort}) == hullNumber;
+	auto const knownRobots = mHullNumbers;
 	mKnownRobotsLock.unlock();
 
-	if (!knownRobot) {
-		// Propagate information about newly connected robot through robot network.
+	if (!knownRobot && !mMulticastSocket) {
+		// Propagate information about newly connected robot through robot network. Not needed if multicast is
+		// enabled, new robot announces itself.
 		forEveryConnection([&ip, &serverPort, &hullNumber](trikKernel::Connection *connection) {
 			QMetaObject::invokeMethod(connection, "sendConnectionInfo"
 					, Q_ARG(QHostAddress const &, ip)
@@ -214,21 +287,20 @@ void MailboxServer::onNewConnection(QHostAddress const &ip, int clientPort, int
 	// Send known connection information to newly connected robot.
 	auto const connectionObject = connection(ip, clientPort);
 	if (connectionObject != nullptr) {
-		mKnownRobotsLock.lockForRead();
-		for (auto const &endpoint: endpoints) {
-			QMetaObject::invokeMethod(connectionObject, "sendConnectionInfo"
-					, Q_ARG(QHostAddress const &, endpoint.ip)
-					, Q_ARG(int, endpoint.port)
-					, Q_ARG(int, mKnownRobots.key(endpoint))
-					);
+		if (!mMulticastSocket) {
+			for (auto robot = knownRobots.constBegin(); robot != knownRobots.constEnd(); ++robot) {
+				QMetaObject::invokeMethod(connectionObject, "sendConnectionInfo"
+						, Q_ARG(QHostAddress const &, robot.key().ip)
+						, Q_ARG(int, robot.key().port)
+						, Q_ARG(int, robot.value())
+						);
+			}
 		}
 
 		// Send information about myself.
 		QMetaObject::invokeMethod(connectionObject, "sendSelfInfo"
 				, Q_ARG(int, mHullNumber)
 				);
-
-		mKnownRobotsLock.unlock();
 	} else {
 		QLOG_ERROR() << "Something went wrong, new connection to" << ip << ":" << clientPort << "is dead";
 		qDebug() << "Something went wrong, new connection to" << ip << ":" << clientPort << "is dead";
@@ -237,95 +309,504 @@ void MailboxServer::onNewConnection(QHostAddress const &ip, int clientPort, int
 
 	if (!knownRobot) {
 		mKnownRobotsLock.lockForWrite();
-
-		mKnownRobots.insertMulti(hullNumber, {ip, serverPort});
+		addKnownRobot(hullNumber, {ip, serverPort});
 		mKnownRobotsLock.unlock();
 	}
 }
 
 void MailboxServer::send(int hullNumber, QString const &message)
 {
-	forEveryConnection([&message](trikKernel::Connection *connection) {
-		auto const data = QString("data:%1").arg(message).toUtf8();
-		QMetaObject::invokeMethod(connection, "send"
-				, Q_ARG(QByteArray const &, data)
-				);
-	}
-	, hullNumber);
+	sendEncoded(hullNumber, MailboxConnection::encodeMessage(message));
 }
 
 void MailboxServer::send(QString const &message)
 {
-	send(-1, message);
+	sendEncoded(-1, MailboxConnection::encodeMessage(message));
 }
 
-void MailboxServer::onConnectionInfo(QHostAddress const &ip, int port, int hullNumber)
+void MailboxServer::sendValue(int hullNumber, QVariant const &value)
 {
-	QList<Endpoint> toDelete;
-	mKnownRobotsLock.lockForRead();
-	for (auto const &endpoint : mKnownRobots.values()) {
-		if (endpoint == Endpoint{ip, port}) {
-			toDelete << endpoint;
+	sendEncoded(hullNumber, MailboxConnection::encodeMessage(value));
+}
+
+void MailboxServer::sendEncoded(int hullNumber, QByteArray const &data)
+{
+	// Timestamp is only sent to peers that advertised support of it, older runtimes reject timestamped messages.
+	QByteArray const timestampedData = MailboxConnection::timestamped(data);
+
+	// Only runtimes that support timestamps listen to multicast group, so broadcasts always have it.
+	bool sentByMulticast = false;
+	if (hullNumber == -1 && mMulticastSocket && timestampedData.size() <= maxDatagramSize) {
+		sentByMulticast = mMulticastSocket->writeDatagram(timestampedData, mMulticastGroup, mMulticastPort)
+				== timestampedData.size();
+		if (!sentByMulticast) {
+			QLOG_ERROR() << "Failed to send multicast datagram:" << mMulticastSocket->errorString();
+			qDebug() << "Failed to send multicast datagram:" << mMulticastSocket->errorString();
 		}
 	}
 
-	mKnownRobotsLock.unlock();
+	// Framing message once for each framing and timestamp support used by connections. Connections work in a thread
+	// of this server, so their framing can be read here directly.
+	QHash<int, QByteArray> frames;
+	forEveryConnection([&data, &timestampedData, &frames](trikKernel::Connection *connection) {
+		bool const withTimestamp = static_cast<MailboxConnection *>(connection)->peerSupportsClock();
+		QByteArray &frame = frames[connection->framingKind() * 2 + (withTimestamp ? 1 : 0)];
+		if (frame.isNull()) {
+			frame = connection->frameMessage(withTimestamp ? timestampedData : data);
+		}
+
+		QMetaObject::invokeMethod(connection, "sendFrame"
+				, Q_ARG(QByteArray const &, frame)
+				);
+	}
+	, hullNumber
+	, sentByMulticast);
+}
+
+void MailboxServer::sendFile(int hullNumber, QString const &path)
+{
+	forEveryConnection([&path](trikKernel::Connection *connection) {
+		QMetaObject::invokeMethod(connection, "sendFile", Q_ARG(QString const &, path));
+	}
+	, hullNumber);
+}
+
+void MailboxServer::sendBlob(int hullNumber, QString const &name, QByteArray const &data)
+{
+	forEveryConnection([&name, &data](trikKernel::Connection *connection) {
+		QMetaObject::invokeMethod(connection, "sendBlob"
+				, Q_ARG(QString const &, name)
+				, Q_ARG(QByteArray const &, data)
+				);
+	}
+	, hullNumber);
+}
 
+void MailboxServer::onConnectionInfo(QHostAddress const &ip, int port, int hullNumber)
+{
 	mKnownRobotsLock.lockForWrite();
-	for (auto const &endpoint : toDelete) {
-		auto const keys = mKnownRobots.keys(endpoint);
-		for (auto const &key : keys) {
-			mKnownRobots.remove(key, endpoint);
+	addKnownRobot(hullNumber, {ip, port});
+	mKnownRobotsLock.unlock();
+}
+
+void MailboxServer::addKnownRobot(int hullNumber, Endpoint const &endpoint)
+{
+	auto const oldHullNumber = mHullNumbers.constFind(endpoint);
+	if (oldHullNumber != mHullNumbers.constEnd()) {
+		if (oldHullNumber.value() == hullNumber) {
+			return;
 		}
+
+		mKnownRobots.remove(oldHullNumber.value(), endpoint);
+		mEndpointsByIp.remove(endpoint.ip, endpoint);
 	}
 
-	mKnownRobots.insertMulti(hullNumber, {ip, port});
+	mKnownRobots.insertMulti(hullNumber, endpoint);
+	mHullNumbers.insert(endpoint, hullNumber);
+	mEndpointsByIp.insertMulti(endpoint.ip, endpoint);
+}
+
+int MailboxServer::knownHullNumber(Endpoint const &endpoint) const
+{
+	return mHullNumbers.value(endpoint, -1);
+}
+
+int MailboxServer::hullNumberByIp(QHostAddress const &ip)
+{
+	mKnownRobotsLock.lockForRead();
+	int const result = mEndpointsByIp.contains(ip) ? knownHullNumber(mEndpointsByIp.value(ip)) : -1;
 	mKnownRobotsLock.unlock();
+	return result;
 }
 
-void MailboxServer::onNewData(QHostAddress const &ip, int port, QByteArray const &data)
+void MailboxServer::onNewData(QHostAddress const &ip, int port, QVariant const &data, qint64 senderTime)
 {
 	QLOG_INFO() << "New data received by a mailbox from " << ip << ":" << port << ", data is:" << data;
 	qDebug() << "New data received by a mailbox from " << ip << ":" << port << ", data is:" << data;
 
-	int senderHullNumber = -1;
-	mKnownRobotsLock.lockForRead();
-	for (auto const &endpoint : mKnownRobots.values()) {
-		if (endpoint.ip == ip) {
-			senderHullNumber = mKnownRobots.key(endpoint);
-		}
-	}
-
-	mKnownRobotsLock.unlock();
+	int const senderHullNumber = hullNumberByIp(ip);
 
 	if (senderHullNumber == -1) {
 		QLOG_INFO() << "Received message from" << ip << ":" << port << "which is unknown at the moment";
 		qDebug() << "Received message from" << ip << ":" << port << "which is unknown at the moment";
 	}
 
+	auto const clock = mPeerClocks.constFind(senderHullNumber);
+	qint64 const localSendTime = senderTime == -1 || clock == mPeerClocks.constEnd()
+			? -1
+			: senderTime - clock.value().clockOffset;
+
+	// Hull number -1 means "any robot" for receive(), so messages of unknown robots have their own queue.
+	int const queueKey = senderHullNumber == -1 ? unknownSenderQueue : senderHullNumber;
+
 	mMessagesQueueLock.lockForWrite();
-	mMessagesQueue.enqueue(data);
+	QQueue<QueuedMessage> &queue = mMessagesQueues[queueKey];
+	queue.enqueue({mNextSequenceNumber++, data, localSendTime});
+	int const queueSize = queue.size();
+	if (mMaxQueueSize > 0 && queueSize > mMaxQueueSize) {
+		queue.dequeue();
+	}
+
+	bool const needPause = mBackpressure && mMaxQueueSize > 0 && queueSize >= mMaxQueueSize;
+	if (needPause) {
+		mPausedQueues.insert(queueKey);
+	}
+
 	mMessagesQueueLock.unlock();
 
-	emit newMessage(senderHullNumber, QString(data));
+	if (mMaxQueueSize > 0 && queueSize > mMaxQueueSize) {
+		QLOG_ERROR() << "Mailbox queue for robot" << senderHullNumber << "is full, oldest message dropped";
+		qDebug() << "Mailbox queue for robot" << senderHullNumber << "is full, oldest message dropped";
+	}
+
+	if (needPause) {
+		auto const connectionObject = connection(ip, port);
+		if (connectionObject != nullptr && !mPausedConnections.contains(queueKey, {ip, port})) {
+			QLOG_INFO() << "Pausing reading from" << ip << ":" << port << ", mailbox queue is full";
+			connectionObject->setReadingPaused(true);
+			mPausedConnections.insertMulti(queueKey, {ip, port});
+		}
+	}
+
+	if (data.type() == QVariant::String) {
+		emit newMessage(senderHullNumber, data.toString());
+	} else {
+		emit newValue(senderHullNumber, data);
+	}
+
+	emit messageEnqueued(senderHullNumber);
 }
 
-bool MailboxServer::hasMessages()
+void MailboxServer::onFileReceived(QHostAddress const &ip, int port, QString const &path)
+{
+	QLOG_INFO() << "File received by a mailbox from" << ip << ":" << port << ", saved to" << path;
+	qDebug() << "File received by a mailbox from" << ip << ":" << port << ", saved to" << path;
+
+	emit fileReceived(hullNumberByIp(ip), path);
+}
+
+void MailboxServer::onClockSample(QHostAddress const &ip, int port, qint64 roundTripTime, qint64 clockOffset)
+{
+	Q_UNUSED(port)
+
+	int const hullNumber = hullNumberByIp(ip);
+	if (hullNumber == -1) {
+		return;
+	}
+
+	PeerClock &clock = mPeerClocks[hullNumber];
+	clock.lastRoundTripTime = roundTripTime;
+	if (clock.samples == 0) {
+		clock.minRoundTripTime = roundTripTime;
+		clock.averageRoundTripTime = roundTripTime;
+	} else {
+		clock.minRoundTripTime = qMin(clock.minRoundTripTime, roundTripTime);
+
+		// Smoothing the same way as TCP does for its round-trip time estimation.
+		clock.averageRoundTripTime += (roundTripTime - clock.averageRoundTripTime) / 8;
+	}
+
+	++clock.samples;
+
+	clock.recentSamples.enqueue({roundTripTime, clockOffset});
+	if (clock.recentSamples.size() > clockSamplesWindow) {
+		clock.recentSamples.dequeue();
+	}
+
+	qint64 bestRoundTripTime = -1;
+	for (auto const &sample : clock.recentSamples) {
+		if (bestRoundTripTime == -1 || sample.first < bestRoundTripTime) {
+			bestRoundTripTime = sample.first;
+			clock.clockOffset = sample.second;
+		}
+	}
+}
+
+QVariantMap MailboxServer::peerStatistics() const
+{
+	QVariantMap result;
+	for (auto clock = mPeerClocks.constBegin(); clock != mPeerClocks.constEnd(); ++clock) {
+		QVariantMap peer;
+		peer["rtt"] = clock.value().lastRoundTripTime;
+		peer["minRtt"] = clock.value().minRoundTripTime;
+		peer["averageRtt"] = clock.value().averageRoundTripTime;
+		peer["clockOffset"] = clock.value().clockOffset;
+		peer["samples"] = clock.value().samples;
+		result[QString::number(clock.key())] = peer;
+	}
+
+	return result;
+}
+
+void MailboxServer::startPinging()
+{
+	mPingTimer = new QTimer(this);
+	QObject::connect(mPingTimer, SIGNAL(timeout()), this, SLOT(pingPeers()));
+	mPingTimer->start(pingIntervalMs);
+}
+
+void MailboxServer::pingPeers()
+{
+	// Pinging only established connections, both incoming and outgoing, so pings do not open new connections.
+	// Connections work in a thread of this server, so their state can be checked here directly.
+	for (trikKernel::Connection * const connectionObject : connections()) {
+		if (connectionObject->isConnected()) {
+			QMetaObject::invokeMethod(connectionObject, "ping");
+		}
+	}
+}
+
+void MailboxServer::startMulticast()
+{
+	mMulticastSocket = new QUdpSocket(this);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+	QHostAddress const bindAddress = QHostAddress::AnyIPv4;
+#else
+	QHostAddress const bindAddress = QHostAddress::Any;
+#endif
+
+	if (!mMulticastSocket->bind(bindAddress, mMulticastPort
+			, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)
+			|| !mMulticastSocket->joinMulticastGroup(mMulticastGroup))
+	{
+		QLOG_ERROR() << "Unable to join mailbox multicast group" << mMulticastGroup << ":" << mMulticastPort
+				<< ":" << mMulticastSocket->errorString();
+		qDebug() << "Unable to join mailbox multicast group" << mMulticastGroup << ":" << mMulticastPort
+				<< ":" << mMulticastSocket->errorString();
+		delete mMulticastSocket;
+		mMulticastSocket = nullptr;
+		return;
+	}
+
+	mMulticastSocket->setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+	mMulticastSocket->setSocketOption(QAbstractSocket::MulticastLoopbackOption, 0);
+
+	QObject::connect(mMulticastSocket, SIGNAL(readyRead()), this, SLOT(onMulticastRead()));
+
+	mAnnounceTimer = new QTimer(this);
+	QObject::connect(mAnnounceTimer, SIGNAL(timeout()), this, SLOT(announce()));
+	mAnnounceTimer->start(announceIntervalMs);
+
+	QLOG_INFO() << "Mailbox joined multicast group" << mMulticastGroup << ":" << mMulticastPort;
+	qDebug() << "Mailbox joined multicast group" << mMulticastGroup << ":" << mMulticastPort;
+
+	announce();
+}
+
+void MailboxServer::announce()
+{
+	QByteArray const datagram = QString("hello:%1:%2").arg(mMyPort).arg(mHullNumber).toUtf8();
+	mMulticastSocket->writeDatagram(datagram, mMulticastGroup, mMulticastPort);
+}
+
+void MailboxServer::onMulticastRead()
+{
+	while (mMulticastSocket->hasPendingDatagrams()) {
+		QByteArray datagram;
+		datagram.resize(static_cast<int>(mMulticastSocket->pendingDatagramSize()));
+		QHostAddress sender;
+		quint16 senderPort = 0;
+		mMulticastSocket->readDatagram(datagram.data(), datagram.size(), &sender, &senderPort);
+
+		if (sender == mMyIp) {
+			continue;
+		}
+
+		// Robot that is heard in multicast group is supposed to hear it too, so it gets broadcasts by multicast only.
+		mMulticastPeers.insert(sender, trikKernel::MonotonicClock::milliseconds());
+
+		if (datagram.startsWith("hello:")) {
+			QList<QByteArray> const parts = datagram.split(':');
+			bool serverPortOk = false;
+			bool hullNumberOk = false;
+			int const serverPort = parts.size() == 3 ? parts[1].toInt(&serverPortOk) : 0;
+			int const hullNumber = parts.size() == 3 ? parts[2].toInt(&hullNumberOk) : 0;
+			if (!serverPortOk || !hullNumberOk) {
+				QLOG_ERROR() << "Malformed multicast announce from" << sender << ":" << datagram;
+				qDebug() << "Malformed multicast announce from" << sender << ":" << datagram;
+				continue;
+			}
+
+			mKnownRobotsLock.lockForRead();
+			bool const knownRobot = knownHullNumber({sender, serverPort}) == hullNumber;
+			mKnownRobotsLock.unlock();
+
+			if (!knownRobot) {
+				onConnectionInfo(sender, serverPort, hullNumber);
+
+				// Answering to a newcomer, so it will not wait for our periodic announce.
+				announce();
+			}
+		} else {
+			QVariant message;
+			qint64 senderTime = -1;
+			if (MailboxConnection::decodeMessage(datagram, message, senderTime)) {
+				onNewData(sender, senderPort, message, senderTime);
+			} else {
+				QLOG_ERROR() << "Unknown multicast datagram from" << sender << ":" << datagram;
+				qDebug() << "Unknown multicast datagram from" << sender << ":" << datagram;
+			}
+		}
+	}
+}
+
+void MailboxServer::setBatchWindow(int batchWindowMs)
+{
+	mBatchWindowMs = batchWindowMs;
+	for (trikKernel::Connection * const connectionObject : connections()) {
+		connectionObject->setBatchWindow(batchWindowMs);
+	}
+}
+
+void MailboxServer::setBinaryFraming(bool enabled, bool compress)
+{
+	mBinaryFraming = enabled;
+	mCompression = compress;
+	for (trikKernel::Connection * const connectionObject : connections()) {
+		connectionObject->setBinaryFraming(enabled, compress);
+	}
+}
+
+void MailboxServer::setMaxReceivedFileSize(qint64 bytes)
+{
+	mMaxReceivedFileSize = bytes;
+	for (trikKernel::Connection * const connectionObject : connections()) {
+		static_cast<MailboxConnection *>(connectionObject)->setMaxReceivedFileSize(bytes);
+	}
+}
+
+QVariantMap MailboxServer::linkStatistics() const
+{
+	QVariantMap result;
+	for (trikKernel::Connection * const connectionObject : connections()) {
+		// Connections that are not created yet or are reconnecting have no peer address.
+		if (!connectionObject->isConnected()) {
+			continue;
+		}
+
+		int const messages = connectionObject->sentMessages();
+		int const writes = connectionObject->socketWrites();
+
+		QVariantMap link;
+		link["messages"] = messages;
+		link["writes"] = writes;
+		link["messagesPerWrite"] = writes == 0 ? 0.0 : static_cast<double>(messages) / writes;
+
+		result[QString("%1:%2").arg(connectionObject->peerAddress().toString()).arg(connectionObject->peerPort())]
+				= link;
+	}
+
+	return result;
+}
+
+void MailboxServer::setQueueLimit(int maxSize, bool backpressure)
+{
+	mMessagesQueueLock.lockForWrite();
+	mMaxQueueSize = qMax(0, maxSize);
+	mBackpressure = backpressure;
+
+	// Limit can be changed by a script at any time, robots paused by the old limit shall not wait for it forever.
+	QList<int> resumed;
+	for (int const queueKey : mPausedQueues) {
+		if (!mBackpressure || mMaxQueueSize == 0
+				|| mMessagesQueues.value(queueKey).size() <= mMaxQueueSize / 2)
+		{
+			resumed << queueKey;
+		}
+	}
+
+	for (int const queueKey : resumed) {
+		mPausedQueues.remove(queueKey);
+	}
+
+	mMessagesQueueLock.unlock();
+
+	for (int const queueKey : resumed) {
+		QMetaObject::invokeMethod(this, "resumeReading", Qt::QueuedConnection, Q_ARG(int, queueKey));
+	}
+}
+
+bool MailboxServer::hasMessages(int hullNumber)
 {
 	mMessagesQueueLock.lockForRead();
-	bool const result = !mMessagesQueue.isEmpty();
+	bool const result = hullNumber == -1 ? !mMessagesQueues.isEmpty() : mMessagesQueues.contains(hullNumber);
 	mMessagesQueueLock.unlock();
 
 	return result;
 }
 
-QString MailboxServer::receive()
+QString MailboxServer::receive(int hullNumber)
 {
+	return receiveValue(hullNumber).toString();
+}
+
+QVariant MailboxServer::receiveValue(int hullNumber)
+{
+	qint64 localSendTime = -1;
+	return receiveValue(hullNumber, localSendTime);
+}
+
+QVariant MailboxServer::receiveValue(int hullNumber, qint64 &localSendTime)
+{
+	localSendTime = -1;
+
 	mMessagesQueueLock.lockForWrite();
-	QByteArray const result = !mMessagesQueue.isEmpty() ? mMessagesQueue.dequeue() : QByteArray();
+	auto queue = mMessagesQueues.end();
+	if (hullNumber != -1) {
+		queue = mMessagesQueues.find(hullNumber);
+	} else {
+		// Looking for the earliest message among heads of all queues, number of queues is the number of robots
+		// sending messages to us.
+		for (auto candidate = mMessagesQueues.begin(); candidate != mMessagesQueues.end(); ++candidate) {
+			if (queue == mMessagesQueues.end()
+					|| candidate.value().head().sequenceNumber < queue.value().head().sequenceNumber)
+			{
+				queue = candidate;
+			}
+		}
+	}
+
+	if (queue == mMessagesQueues.end()) {
+		mMessagesQueueLock.unlock();
+		return QVariant();
+	}
+
+	int const queueKey = queue.key();
+	QueuedMessage const message = queue.value().dequeue();
+	QVariant const result = message.data;
+	localSendTime = message.localSendTime;
+	int const queueSize = queue.value().size();
+	if (queueSize == 0) {
+		mMessagesQueues.erase(queue);
+	}
+
+	bool const needResume = mPausedQueues.contains(queueKey) && queueSize <= mMaxQueueSize / 2;
+	if (needResume) {
+		mPausedQueues.remove(queueKey);
+	}
+
 	mMessagesQueueLock.unlock();
 
-	return QString(result);
+	if (needResume) {
+		// We are called from script thread, connections shall be resumed in a thread of a server.
+		QMetaObject::invokeMethod(this, "resumeReading", Qt::QueuedConnection, Q_ARG(int, queueKey));
+	}
+
+	return result;
+}
+
+void MailboxServer::resumeReading(int hullNumber)
+{
+	for (auto const &endpoint : mPausedConnections.values(hullNumber)) {
+		auto const connectionObject = connection(endpoint.ip, endpoint.port);
+		if (connectionObject != nullptr) {
+			QLOG_INFO() << "Resuming reading from" << endpoint;
+			connectionObject->setReadingPaused(false);
+		}
+	}
+
+	mPausedConnections.remove(hullNumber);
 }
 
 void MailboxServer::loadSettings()
@@ -348,13 +829,21 @@ void MailboxServer::saveSettings()
 	mAuxiliaryInformationLock.unlock();
 }
 
-void MailboxServer::forEveryConnection(std::function<void(trikKernel::Connection *)> method, int hullNumber)
+void MailboxServer::forEveryConnection(std::function<void(trikKernel::Connection *)> method, int hullNumber
+		, bool skipMulticastPeers)
 {
 	mKnownRobotsLock.lockForRead();
 	auto const endpoints = hullNumber == -1 ? mKnownRobots.values() : mKnownRobots.values(hullNumber);
 	mKnownRobotsLock.unlock();
 
+	qint64 const now = trikKernel::MonotonicClock::milliseconds();
 	for (auto const &endpoint : endpoints) {
+		if (skipMulticastPeers && mMulticastPeers.contains(endpoint.ip)
+				&& now - mMulticastPeers.value(endpoint.ip) < multicastPeerTimeoutMs)
+		{
+			continue;
+		}
+
 		auto const connection = prepareConnection(endpoint.ip);
 		if (connection == nullptr) {
 			QLOG_ERROR() << "Connection to" << endpoint.ip << ":" << endpoint.port << "is dead at the moment, message"
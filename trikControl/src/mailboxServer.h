@@ -15,10 +15,15 @@
 #pragma once
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 #include <QtCore/QMultiHash>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QVariant>
 #include <QtNetwork/QHostAddress>
+#include <QtNetwork/QUdpSocket>
 
 #include <trikKernel/trikServer.h>
 
@@ -26,9 +31,18 @@
 
 namespace trikControl {
 
+class MailboxConnection;
+
 /// Worker object for mailbox functionality. It is a server that is supposed to be run in a separate thread and
 /// it allows to handle a number of connections, keeping them open if possible or attempting to reestablish them if
-/// they errored.
+/// they errored. All connections work in the same thread as a server.
+///
+/// Optionally uses UDP multicast group for discovery and broadcasts: every robot periodically announces its hull
+/// number and server port to a group, so membership is learned without propagating "connection:" records over TCP,
+/// and message for all robots is sent as one datagram regardless of the number of robots. Robots that were not heard
+/// in a group recently (multicast is disabled there, they run older runtime or multicast is dropped by a network)
+/// get broadcasts over TCP. Datagrams are not guaranteed to be delivered and may be reordered relative to TCP
+/// messages.
 ///
 /// Uses localSettings.ini settings file, keys:
 /// hullNumber - hull number of this robot.
@@ -41,9 +55,9 @@ class MailboxServer : public trikKernel::TrikServer
 public:
 	/// Constructor.
 	/// @param port - a port for mailbox server.
-	/// @param receiveWaitCondition - reference to a wait condition that is shared with "frontend" mailbox object
-	///        and is used to block script execution on receive() call until new message arrives.
-	MailboxServer(int port);
+	/// @param multicastGroup - IPv4 multicast group address for discovery and broadcasts, empty to disable multicast.
+	/// @param multicastPort - UDP port for multicast datagrams.
+	MailboxServer(int port, QString const &multicastGroup = QString(), int multicastPort = 0);
 
 	/// Returns hull number of this robot.
 	int hullNumber() const;
@@ -69,24 +83,113 @@ public:
 	/// Sends message to all known robots.
 	Q_INVOKABLE void send(QString const &message);
 
-	/// Returns true if there are incoming messages.
-	Q_INVOKABLE bool hasMessages();
+	/// Sends binary or typed message to a robot with given hull number, or to all known robots if hull number is -1.
+	/// QByteArray is sent as is, other types are serialized with QDataStream.
+	Q_INVOKABLE void sendValue(int hullNumber, QVariant const &value);
+
+	/// Sends a file to a robot with given hull number, or to all known robots if hull number is -1. File is sent
+	/// by chunks in background, receiver gets fileReceived() signal when it is completely received.
+	Q_INVOKABLE void sendFile(int hullNumber, QString const &path);
+
+	/// Sends in-memory data to a robot with given hull number, or to all known robots if hull number is -1.
+	/// Receiver gets it as a file with given name.
+	Q_INVOKABLE void sendBlob(int hullNumber, QString const &name, QByteArray const &data);
+
+	/// Limits the number of not received messages from one robot. Thread-safe.
+	/// @param maxSize - maximal number of queued messages from one robot, 0 means unlimited.
+	/// @param backpressure - if true, reading from connections of a robot with full queue is paused until a script
+	///        receives half of the queue, so a sender is slowed down by TCP flow control. Otherwise oldest message is
+	///        dropped. Messages received by multicast are always dropped when a queue is full.
+	void setQueueLimit(int maxSize, bool backpressure);
+
+	/// Sets sending mode for all current and future connections to other robots, see
+	/// trikKernel::Connection::setBatchWindow().
+	Q_INVOKABLE void setBatchWindow(int batchWindowMs);
+
+	/// Sets wire format for all current and future connections to other robots, see
+	/// trikKernel::Connection::setBinaryFraming(). Robots that receive binary frames answer with them too.
+	Q_INVOKABLE void setBinaryFraming(bool enabled, bool compress);
+
+	/// Sets maximal size of a file received from other robots for all current and future connections, larger files
+	/// are rejected.
+	/// @param bytes - maximal file size in bytes, 0 means unlimited.
+	Q_INVOKABLE void setMaxReceivedFileSize(qint64 bytes);
 
-	/// Returns one incoming message or empty string if there are none.
-	Q_INVOKABLE QString receive();
+	/// Returns sending statistics of every open link, keys are "<ip>:<port>", values are maps with "messages",
+	/// "writes" and "messagesPerWrite" keys.
+	Q_INVOKABLE QVariantMap linkStatistics() const;
+
+	/// Returns true if there are incoming messages from a robot with given hull number, or from any robot if hull
+	/// number is -1. Thread-safe.
+	Q_INVOKABLE bool hasMessages(int hullNumber = -1);
+
+	/// Returns one incoming message from a robot with given hull number (or the earliest message from any robot if
+	/// hull number is -1) converted to string or empty string if there are none. Thread-safe.
+	Q_INVOKABLE QString receive(int hullNumber = -1);
+
+	/// Same as receive(), but returns message as is or invalid QVariant if there are none. Thread-safe.
+	Q_INVOKABLE QVariant receiveValue(int hullNumber = -1);
+
+	/// Same as receiveValue(), also returns time when message was sent.
+	/// @param localSendTime - time when message was sent by a sender, converted to our monotonic clock (see
+	///        trikKernel::MonotonicClock) in microseconds, or -1 if clock offset of a sender is not known yet.
+	QVariant receiveValue(int hullNumber, qint64 &localSendTime);
+
+	/// Returns round-trip time and clock offset statistics, keys are hull numbers, values are maps with "rtt",
+	/// "minRtt", "averageRtt", "clockOffset" (all in microseconds) and "samples" keys. Clock offset is an
+	/// estimated difference between monotonic clock of a robot and ours.
+	Q_INVOKABLE QVariantMap peerStatistics() const;
 
 signals:
-	/// Emitted when new message was received from a robot with given hull number.
+	/// Emitted when new text message was received from a robot with given hull number.
 	void newMessage(int senderHullNumber, QString const &message);
 
+	/// Emitted when new binary or typed message was received from a robot with given hull number.
+	void newValue(int senderHullNumber, QVariant const &value);
+
+	/// Emitted when a file from a robot with given hull number is completely received and verified.
+	/// @param path - full path to a received file in a temporary directory.
+	void fileReceived(int senderHullNumber, QString const &path);
+
+	/// Emitted when any message is put into a queue, after newMessage() or newValue().
+	void messageEnqueued(int senderHullNumber);
+
 private slots:
 	void onNewConnection(QHostAddress const &ip, int clientPort, int serverPort, int hullNumber);
 	void onConnectionInfo(QHostAddress const &ip, int port, int hullNumber);
-	void onNewData(QHostAddress const &ip, int port, QByteArray const &data);
+	void onNewData(QHostAddress const &ip, int port, QVariant const &data, qint64 senderTime);
+	void onClockSample(QHostAddress const &ip, int port, qint64 roundTripTime, qint64 clockOffset);
+	void onFileReceived(QHostAddress const &ip, int port, QString const &path);
+
+	/// Removes closed outgoing connection from mOutgoingConnections.
+	void onOutgoingConnectionClosed();
+
+	/// Resumes reading from connections to a robot paused by backpressure.
+	/// @param hullNumber - key of a message queue of a robot, see mMessagesQueues.
+	void resumeReading(int hullNumber);
+
+	/// Joins multicast group and starts periodic announces. Called when server is already in its working thread.
+	void startMulticast();
+
+	/// Starts periodic pinging of connected robots. Called when server is already in its working thread.
+	void startPinging();
+
+	/// Sends "ping" through every established connection.
+	void pingPeers();
+
+	/// Sends "hello" datagram with our hull number and server port to a multicast group.
+	void announce();
+
+	/// Reads and processes pending multicast datagrams.
+	void onMulticastRead();
 
 private:
 	trikKernel::Connection *connect(QHostAddress const &ip, int port);
 
+	/// Sends already encoded message to robots with given hull number, or to all robots if hull number is -1.
+	/// Broadcasts are sent by one multicast datagram if possible, and over TCP to robots not heard in multicast group.
+	void sendEncoded(int hullNumber, QByteArray const &data);
+
 	trikKernel::Connection *connectionFactory();
 
 	void connectConnection(trikKernel::Connection * connection);
@@ -98,7 +201,10 @@ private:
 	void loadSettings();
 	void saveSettings();
 
-	void forEveryConnection(std::function<void(trikKernel::Connection *)> method, int hullNumber = -1);
+	/// Calls given method for connections to robots with given hull number, or to all robots if hull number is -1.
+	/// @param skipMulticastPeers - if true, robots recently heard in multicast group are skipped.
+	void forEveryConnection(std::function<void(trikKernel::Connection *)> method, int hullNumber = -1
+			, bool skipMulticastPeers = false);
 
 	int mHullNumber;
 	QHostAddress const mMyIp;
@@ -106,23 +212,116 @@ private:
 	QHostAddress mServerIp;
 	int mServerPort;
 
+	/// Multicast group for discovery and broadcasts, null if multicast is disabled.
+	QHostAddress const mMulticastGroup;
+	int const mMulticastPort;
+
+	/// Socket for multicast datagrams, created only if multicast is enabled.
+	QUdpSocket *mMulticastSocket = nullptr;  // Has ownership via Qt parent-child system.
+
+	/// Time of the last datagram received in multicast group (see trikKernel::MonotonicClock) by robot IP. Used only
+	/// in a thread of a server.
+	QHash<QHostAddress, qint64> mMulticastPeers;
+
+	/// Timer for periodic announces to multicast group.
+	QTimer *mAnnounceTimer = nullptr;  // Has ownership via Qt parent-child system.
+
+	/// Timer for periodic pings of connected robots.
+	QTimer *mPingTimer = nullptr;  // Has ownership via Qt parent-child system.
+
 	struct Endpoint {
 		QHostAddress ip;
 		int port;
 	};
 
-	inline uint qHash(Endpoint const &key)
-	{
-		return ::qHash(key.ip.toString()) ^ key.port;
-	}
-
 	friend bool operator ==(MailboxServer::Endpoint const &left, MailboxServer::Endpoint const &right);
 	friend inline QDebug operator <<(QDebug dbg, Endpoint const &endpoint);
+	friend inline uint qHash(MailboxServer::Endpoint const &key);
+
+	/// Adds robot to routing tables or updates its hull number if its endpoint is already known.
+	/// Shall be called with mKnownRobotsLock locked for write.
+	void addKnownRobot(int hullNumber, Endpoint const &endpoint);
+
+	/// Returns hull number of a robot with given endpoint or -1 if it is unknown.
+	/// Shall be called with mKnownRobotsLock locked.
+	int knownHullNumber(Endpoint const &endpoint) const;
+
+	/// Returns hull number of a robot with given IP or -1 if it is unknown. Locks mKnownRobotsLock itself.
+	int hullNumberByIp(QHostAddress const &ip);
 
+	/// Maps hull number to endpoints of robots with this hull number. Following three tables are indexes of the same
+	/// information, they are always updated together under mKnownRobotsLock, see addKnownRobot().
 	QMultiHash<int, Endpoint> mKnownRobots;
 
-	QQueue<QByteArray> mMessagesQueue;
+	/// Maps endpoint of a robot to its hull number.
+	QHash<Endpoint, int> mHullNumbers;
+
+	/// Maps IP of a robot to its endpoints.
+	QMultiHash<QHostAddress, Endpoint> mEndpointsByIp;
+
+	struct QueuedMessage {
+		/// Number of a message in order of arrival among messages from all robots.
+		quint64 sequenceNumber;
+		QVariant data;
+
+		/// Time when message was sent by a sender on our monotonic clock in microseconds, -1 if unknown.
+		qint64 localSendTime;
+	};
+
+	/// Maps hull number of a sender to a queue of not received messages from it. Empty queues are removed. Messages
+	/// from robots with unknown hull number are queued under a key that is not a valid hull number.
+	QHash<int, QQueue<QueuedMessage>> mMessagesQueues;
+
+	/// Sequence number for the next incoming message.
+	quint64 mNextSequenceNumber = 0;
+
+	/// Sending mode for connections, see trikKernel::Connection::setBatchWindow().
+	int mBatchWindowMs = 0;
+
+	/// Wire format for connections, see trikKernel::Connection::setBinaryFraming().
+	bool mBinaryFraming = false;
+	bool mCompression = false;
+
+	/// Maximal size of a received file in bytes, 0 if unlimited.
+	qint64 mMaxReceivedFileSize;
+
+	/// Maximal number of queued messages from one robot, 0 if unlimited.
+	int mMaxQueueSize = 0;
+
+	/// True if reading from a robot shall be paused when its queue is full, false if oldest messages are dropped.
+	bool mBackpressure = false;
+
+	/// Keys of message queues whose senders are paused by backpressure. Guarded by mMessagesQueueLock.
+	QSet<int> mPausedQueues;
+
+	/// Guards message queues and queue limits.
 	QReadWriteLock mMessagesQueueLock;
+
+	/// Outgoing connections by target endpoint, including not yet established and reconnecting ones, so new
+	/// connection is not opened while previous one to the same robot is pending. Used only in a thread of a server.
+	QHash<Endpoint, MailboxConnection *> mOutgoingConnections;
+
+	/// Round-trip time and clock offset of a robot, estimated from ping samples.
+	struct PeerClock {
+		qint64 lastRoundTripTime = 0;
+		qint64 minRoundTripTime = 0;
+		qint64 averageRoundTripTime = 0;
+
+		/// Clock offset measured by a sample with the least round-trip time among recent ones, since it has the
+		/// least error caused by asymmetric delays.
+		qint64 clockOffset = 0;
+
+		int samples = 0;
+
+		/// Round-trip times and clock offsets of last few samples.
+		QQueue<QPair<qint64, qint64>> recentSamples;
+	};
+
+	/// Clock statistics by hull number of a robot. Used only in a thread of a server.
+	QHash<int, PeerClock> mPeerClocks;
+
+	/// Connections paused by backpressure, by hull number of a robot. Used only in a thread of a server.
+	QMultiHash<int, Endpoint> mPausedConnections;
 	QReadWriteLock mKnownRobotsLock;
 
 	QReadWriteLock mAuxiliaryInformationLock;
@@ -133,6 +332,11 @@ inline bool operator ==(MailboxServer::Endpoint const &left, MailboxServer::Endp
 	return left.ip == right.ip && left.port == right.port;
 }
 
+inline uint qHash(MailboxServer::Endpoint const &key)
+{
+	return qHash(key.ip) ^ static_cast<uint>(key.port);
+}
+
 inline QDebug operator <<(QDebug dbg, MailboxServer::Endpoint const &endpoint)
 {
 	dbg.nospace() << endpoint.ip << ":" << endpoint.port;
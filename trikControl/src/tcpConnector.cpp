@@ -14,15 +14,28 @@
 
 #include "src/tcpConnector.h"
 
-#include <QtCore/QDataStream>
+#include <trikKernel/monotonicClock.h>
 
 #include "QsLog.h"
 
 using namespace trikControl;
 
-TcpConnector::TcpConnector(int port)
+/// Gamepad commands are short, so longer line without separator means that client is misbehaving.
+qint64 const maxCommandLength = 1024;
+
+TcpConnector::TcpConnector(int port, bool legacyFraming)
 	: mPort(port)
+	, mLegacyFraming(legacyFraming)
+{
+}
+
+TcpConnector::~TcpConnector()
 {
+	for (QTcpSocket * const socket : mTcpSockets) {
+		socket->disconnect(this);
+	}
+
+	qDeleteAll(mTcpSockets);
 }
 
 void TcpConnector::startServer()
@@ -43,31 +56,55 @@ void TcpConnector::startServer()
 
 void TcpConnector::connection()
 {
-	mTcpSocket.reset(mTcpServer->nextPendingConnection());
-	mTcpSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
-	QLOG_INFO() << "Set new connection";
-	qDebug() << "Set new connection";
-	connect(mTcpSocket.data(), SIGNAL(disconnected()), this, SLOT(tcpDisconnected()));
-	connect(mTcpSocket.data(), SIGNAL(readyRead()), this, SLOT(networkRead()));
+	while (mTcpServer->hasPendingConnections()) {
+		QTcpSocket * const socket = mTcpServer->nextPendingConnection();
+		socket->setParent(nullptr);
+		socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+		QLOG_INFO() << "Set new connection from" << socket->peerAddress() << ":" << socket->peerPort();
+		qDebug() << "Set new connection from" << socket->peerAddress() << ":" << socket->peerPort();
+		connect(socket, SIGNAL(disconnected()), this, SLOT(tcpDisconnected()));
+		connect(socket, SIGNAL(readyRead()), this, SLOT(networkRead()));
+		mTcpSockets.append(socket);
+	}
 }
 
 void TcpConnector::tcpDisconnected()
 {
-	mTcpSocket->abort();
+	QTcpSocket * const socket = static_cast<QTcpSocket *>(sender());
+	QLOG_INFO() << "Gamepad client disconnected, clients left:" << mTcpSockets.size() - 1;
+	mTcpSockets.removeAll(socket);
+	socket->deleteLater();
 }
 
 void TcpConnector::networkRead()
 {
-	if (!mTcpSocket->isValid()) {
+	QTcpSocket * const socket = static_cast<QTcpSocket *>(sender());
+	if (!socket->isValid()) {
+		return;
+	}
+
+	qint64 const receiveTime = trikKernel::MonotonicClock::microseconds();
+	if (mLegacyFraming) {
+		// Old clients send each command by one write and do not terminate it, so everything read at once is
+		// a command.
+		QByteArray const command = socket->readAll().trimmed();
+		if (!command.isEmpty()) {
+			emit dataReady(QString::fromUtf8(command), receiveTime);
+		}
+
 		return;
 	}
 
-	QString line;
-	while (mTcpSocket->bytesAvailable() > 0) {
-		char data[100];
-		mTcpSocket->readLine(data, 100);
-		line += data;
+	while (socket->canReadLine()) {
+		QByteArray const line = socket->readLine().trimmed();
+		if (!line.isEmpty()) {
+			emit dataReady(QString::fromUtf8(line), receiveTime);
+		}
 	}
 
-	emit dataReady(line);
+	if (socket->bytesAvailable() > maxCommandLength) {
+		QLOG_ERROR() << "Gamepad command is too long, discarding" << socket->bytesAvailable() << "bytes";
+		qDebug() << "Gamepad command is too long, discarding" << socket->bytesAvailable() << "bytes";
+		socket->readAll();
+	}
 }
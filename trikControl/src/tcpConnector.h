@@ -15,13 +15,17 @@
 #pragma once
 
 #include <QtCore/QObject>
+#include <QtCore/QList>
 #include <QtNetwork/QTcpSocket>
 #include <QtNetwork/QTcpServer>
 #include <QtCore/QScopedPointer>
 
 namespace trikControl {
 
-/// TCP server.
+/// TCP server for gamepad commands. Accepts any number of clients simultaneously, each client sends commands
+/// separated by newline. Every complete command is emitted separately, in order of arrival, incomplete command is
+/// kept in a socket buffer until the rest of it arrives. Old clients that do not terminate commands are supported by
+/// legacy framing mode, where everything received by one read is a command, as it was before newline framing.
 class TcpConnector : public QObject
 {
 	Q_OBJECT
@@ -29,11 +33,16 @@ class TcpConnector : public QObject
 public:
 	/// Constructor.
 	/// @param port - TCP port of a server.
-	TcpConnector(int port);
+	/// @param legacyFraming - if true, commands are not separated by newline, every read is a command.
+	TcpConnector(int port, bool legacyFraming = false);
+
+	~TcpConnector() override;
 
 signals:
 	/// Emitted when there is incoming TCP message.
-	void dataReady(QString const &message);
+	/// @param message - command text.
+	/// @param receiveTime - trikKernel::MonotonicClock time in microseconds when a command was read.
+	void dataReady(QString const &message, qint64 receiveTime);
 
 public slots:
 	/// Starts a server and begins listening port for incoming connections.
@@ -46,8 +55,13 @@ private slots:
 
 private:
 	int mPort;
+
+	/// True if commands are not separated by newline and every read is a command.
+	bool mLegacyFraming;
 	QScopedPointer<QTcpServer> mTcpServer;
-	QScopedPointer<QTcpSocket> mTcpSocket;
+
+	/// Currently connected clients.
+	QList<QTcpSocket *> mTcpSockets;  // Has ownership.
 };
 
 }
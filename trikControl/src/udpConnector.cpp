@@ -0,0 +1,60 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "src/udpConnector.h"
+
+#include <QtCore/QList>
+
+#include <trikKernel/monotonicClock.h>
+
+#include "QsLog.h"
+
+using namespace trikControl;
+
+UdpConnector::UdpConnector(int port)
+	: mPort(port)
+{
+}
+
+void UdpConnector::startServer()
+{
+	mUdpSocket.reset(new QUdpSocket());
+
+	if (!mUdpSocket->bind(QHostAddress::Any, mPort)) {
+		QLOG_ERROR() << "Unable to bind UDP gamepad socket:" << mUdpSocket->errorString();
+		qDebug() << "Unable to bind UDP gamepad socket:" << mUdpSocket->errorString();
+		return;
+	}
+
+	QLOG_INFO() << "UDP gamepad server started";
+	qDebug() << "UDP gamepad server started";
+	connect(mUdpSocket.data(), SIGNAL(readyRead()), this, SLOT(networkRead()));
+}
+
+void UdpConnector::networkRead()
+{
+	while (mUdpSocket->hasPendingDatagrams()) {
+		QByteArray datagram;
+		datagram.resize(static_cast<int>(mUdpSocket->pendingDatagramSize()));
+		mUdpSocket->readDatagram(datagram.data(), datagram.size());
+		qint64 const receiveTime = trikKernel::MonotonicClock::microseconds();
+
+		for (QByteArray const &command : datagram.split('\n')) {
+			QByteArray const trimmed = command.trimmed();
+			if (!trimmed.isEmpty()) {
+				emit dataReady(QString::fromUtf8(trimmed), receiveTime);
+			}
+		}
+	}
+}
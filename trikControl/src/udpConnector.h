@@ -0,0 +1,54 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QScopedPointer>
+#include <QtNetwork/QUdpSocket>
+
+namespace trikControl {
+
+/// UDP server for gamepad commands, alternative to TcpConnector for minimal latency: there is no connection setup,
+/// no Nagle delays and no retransmission stalls, lost datagram just means lost event. Any number of clients may send
+/// datagrams to a port, each datagram contains one or more commands separated by newline, commands are emitted
+/// in order of arrival.
+class UdpConnector : public QObject
+{
+	Q_OBJECT
+
+public:
+	/// Constructor.
+	/// @param port - UDP port to listen.
+	UdpConnector(int port);
+
+signals:
+	/// Emitted for every received command.
+	/// @param message - command text.
+	/// @param receiveTime - trikKernel::MonotonicClock time in microseconds when a command was read.
+	void dataReady(QString const &message, qint64 receiveTime);
+
+public slots:
+	/// Binds a socket and starts receiving datagrams.
+	void startServer();
+
+private slots:
+	void networkRead();
+
+private:
+	int mPort;
+	QScopedPointer<QUdpSocket> mUdpSocket;
+};
+
+}
@@ -44,6 +44,8 @@ HEADERS += \
 	$$PWD/src/colorSensorWorker.h \
 	$$PWD/src/configurer.h \
 	$$PWD/src/continiousRotationServoMotor.h \
+	$$PWD/src/displayMirror.h \
+	$$PWD/src/flightRecorder.h \
 	$$PWD/src/graphicsWidget.h \
 	$$PWD/src/guiWorker.h \
 	$$PWD/src/i2cCommunicator.h \
@@ -56,6 +58,7 @@ HEADERS += \
 	$$PWD/src/sensor3dWorker.h \
 	$$PWD/src/servoMotor.h \
 	$$PWD/src/tcpConnector.h \
+	$$PWD/src/udpConnector.h \
 
 SOURCES += \
 	$$PWD/src/analogSensor.cpp \
@@ -68,7 +71,9 @@ SOURCES += \
 	$$PWD/src/continiousRotationServoMotor.cpp \
 	$$PWD/src/digitalSensor.cpp \
 	$$PWD/src/display.cpp \
+	$$PWD/src/displayMirror.cpp \
 	$$PWD/src/encoder.cpp \
+	$$PWD/src/flightRecorder.cpp \
 	$$PWD/src/gamepad.cpp \
 	$$PWD/src/graphicsWidget.cpp \
 	$$PWD/src/guiWorker.cpp \
@@ -86,6 +91,7 @@ SOURCES += \
 	$$PWD/src/sensor3d.cpp \
 	$$PWD/src/servoMotor.cpp \
 	$$PWD/src/tcpConnector.cpp \
+	$$PWD/src/udpConnector.cpp \
 	$$PWD/src/$$PLATFORM/abstractVirtualSensorWorker.cpp \
 	$$PWD/src/$$PLATFORM/i2cCommunicator.cpp \
 	$$PWD/src/$$PLATFORM/keysWorker.cpp \
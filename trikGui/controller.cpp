@@ -18,8 +18,6 @@
 #include <QtCore/QFileInfo>
 #include <QtCore/QDebug>
 
-#include <trikKernel/fileUtils.h>
-
 #include "runningWidget.h"
 
 using namespace trikGui;
@@ -53,7 +51,7 @@ void Controller::runFile(QString const &filePath)
 {
 	QFileInfo const fileInfo(filePath);
 	if (fileInfo.suffix() == "qts" || fileInfo.suffix() == "js") {
-		mScriptRunner.run(trikKernel::FileUtils::readFromFile(fileInfo.canonicalFilePath()), fileInfo.baseName());
+		mScriptRunner.runFile(fileInfo.canonicalFilePath(), fileInfo.baseName());
 	} else if (fileInfo.suffix() == "wav" || fileInfo.suffix() == "mp3") {
 		mScriptRunner.run("brick.playSound(\"" + fileInfo.canonicalFilePath() + "\");", fileInfo.baseName());
 	} else if (fileInfo.suffix() == "sh") {
@@ -0,0 +1,150 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/// Benchmark of parsing incoming data by trikKernel::Connection. Sends a burst of many small messages and a series
+/// of large messages through a loopback TCP connection and reports how fast they are delivered to processData().
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtNetwork/QTcpSocket>
+
+#include <trikKernel/connection.h>
+#include <trikKernel/trikServer.h>
+
+/// Number of messages in a burst workload.
+int const burstMessages = 200000;
+
+/// Size of a message in a burst workload.
+int const burstMessageSize = 32;
+
+/// Number of messages in a large-message workload.
+int const largeMessages = 16;
+
+/// Size of a message in a large-message workload, below the maximal message size accepted by a connection.
+int const largeMessageSize = 8 * 1024 * 1024;
+
+/// Time after which a workload is considered hung.
+int const workloadTimeoutMs = 60000;
+
+/// Connection that only counts received messages.
+class CountingConnection : public trikKernel::Connection
+{
+public:
+	explicit CountingConnection(trikKernel::Protocol protocol)
+		: trikKernel::Connection(protocol)
+	{
+	}
+
+	/// Returns number of messages received so far.
+	int messages() const
+	{
+		return mMessages;
+	}
+
+	/// Returns total size of messages received so far.
+	qint64 bytes() const
+	{
+		return mBytes;
+	}
+
+private:
+	void processData(QByteArray const &data) override
+	{
+		++mMessages;
+		mBytes += data.size();
+	}
+
+	int mMessages = 0;
+	qint64 mBytes = 0;
+};
+
+/// Server that accepts benchmark connections in its own thread and remembers the last one.
+class BenchmarkServer : public trikKernel::TrikServer
+{
+public:
+	explicit BenchmarkServer(trikKernel::Protocol protocol)
+		: trikKernel::TrikServer([this, protocol]() {
+				mLastConnection = new CountingConnection(protocol);
+				return mLastConnection;
+			})
+	{
+		setConnectionThreadsCount(0);
+	}
+
+	/// Returns the last accepted connection, or nullptr if there was none.
+	CountingConnection *lastConnection() const
+	{
+		return mLastConnection;
+	}
+
+private:
+	CountingConnection *mLastConnection = nullptr;  // Does not have ownership.
+};
+
+/// Sends given number of messages with given size framed by given protocol and reports delivery speed.
+static bool runWorkload(QString const &name, trikKernel::Protocol protocol, int messages, int messageSize)
+{
+	BenchmarkServer server(protocol);
+	server.startServer(0);
+
+	QTcpSocket client;
+	client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+	if (!client.waitForConnected()) {
+		qDebug() << name << ": failed to connect:" << client.errorString();
+		return false;
+	}
+
+	QByteArray const message(messageSize, 'x');
+	QByteArray const frame = protocol == trikKernel::Protocol::messageLength
+			? QByteArray::number(messageSize) + ':' + message
+			: message + '\n';
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for (int i = 0; i < messages; ++i) {
+		client.write(frame);
+	}
+
+	while (!server.lastConnection() || server.lastConnection()->messages() < messages) {
+		if (timer.elapsed() > workloadTimeoutMs) {
+			qDebug() << name << ": timed out";
+			return false;
+		}
+
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+	}
+
+	qint64 const elapsedMs = qMax<qint64>(1, timer.elapsed());
+	double const megabytes = server.lastConnection()->bytes() / (1024.0 * 1024.0);
+	qDebug() << name << ":" << messages << "messages of" << messageSize << "bytes in" << elapsedMs << "ms,"
+			<< messages * 1000.0 / elapsedMs << "messages/s," << megabytes * 1000.0 / elapsedMs << "MB/s";
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	bool const success = runWorkload("burst, message length", trikKernel::Protocol::messageLength
+					, burstMessages, burstMessageSize)
+			&& runWorkload("burst, end of line", trikKernel::Protocol::endOfLineSeparator
+					, burstMessages, burstMessageSize)
+			&& runWorkload("large messages", trikKernel::Protocol::messageLength
+					, largeMessages, largeMessageSize);
+
+	return success ? 0 : 1;
+}
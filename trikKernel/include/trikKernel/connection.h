@@ -16,12 +16,17 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QTimer>
 #include <QtNetwork/QTcpSocket>
 #include <QtNetwork/QHostAddress>
 
 namespace trikKernel {
 
-/// Connection protocol variants.
+/// Connection protocol variants. Any connection also accepts binary frames, see Connection::setBinaryFraming().
 enum class Protocol
 {
 	/// Message is in form "<data length in bytes>:<data>".
@@ -31,8 +36,34 @@ enum class Protocol
 	, endOfLineSeparator
 };
 
-/// Abstract class that serves one client of TrikServer. Meant to work in separate thread. Creates its own socket and
-/// handles all incoming messages.
+class Connection;
+
+/// Message sent to many connections at once. Each connection frames it in its own thread, and connections with the
+/// same framing kind share one frame, so message is encoded only once for each framing in use.
+class BroadcastMessage
+{
+public:
+	/// Constructor.
+	/// @param data - message to send.
+	explicit BroadcastMessage(QByteArray const &data);
+
+	/// Returns message framed for given connection, reusing a frame made for other connection with the same framing
+	/// kind. Can be called concurrently from threads of different connections.
+	QByteArray frame(Connection const &connection);
+
+private:
+	QByteArray const mData;
+
+	/// Frames of a message by framing kind.
+	QHash<int, QByteArray> mFrames;
+
+	/// Guards mFrames.
+	QMutex mMutex;
+};
+
+/// Abstract class that serves one client of TrikServer. Works either in its own thread or in a thread of a server,
+/// depending on server settings, never blocks, so many connections can share one event loop. Creates its own socket
+/// and handles all incoming messages.
 class Connection : public QObject
 {
 	Q_OBJECT
@@ -42,6 +73,10 @@ public:
 	/// @param connectionProtocol - protocol used by this connection.
 	explicit Connection(Protocol connectionProtocol);
 
+	/// Returns true if connection is established and data can be sent right now. Shall be called from a thread of
+	/// a connection.
+	bool isConnected() const;
+
 	/// Returns peer address of a connection, if it is open, or empty QHostAddress if connection is not established yet.
 	QHostAddress peerAddress() const;
 
@@ -53,17 +88,104 @@ public:
 	/// @param socketDescriptor - native socket descriptor.
 	Q_INVOKABLE void init(int socketDescriptor);
 
-	/// Sends given byte array to peer.
+	/// Sends given byte array to peer. If outgoing connection is not established yet or is being reestablished,
+	/// message is queued and will be sent right after connection succeeds.
 	Q_INVOKABLE void send(QByteArray const &data);
 
+	/// Sends message with given type tag. Type is delivered to a peer only in binary framing mode, text protocols
+	/// deliver only data.
+	/// @param type - application-defined message type, 0-255.
+	Q_INVOKABLE void sendTyped(QByteArray const &data, int type);
+
+	/// Same as send(), but takes a message already framed by frameMessage() of a connection with the same
+	/// framingKind(). Allows to encode a message sent to many connections only once. Shall be called from a thread
+	/// of a connection, since framing of a connection may change when it receives a binary frame.
+	Q_INVOKABLE void sendFrame(QByteArray const &frame);
+
+	/// Sends message shared with other connections, framing it in a thread of this connection. Can be posted to
+	/// connections working in different threads.
+	Q_INVOKABLE void sendBroadcast(QSharedPointer<trikKernel::BroadcastMessage> const &message);
+
+	/// Returns given message framed according to current settings of this connection, ready to be written to
+	/// a socket. Shall be called from a thread of a connection.
+	QByteArray frameMessage(QByteArray const &data) const;
+
+	/// Returns a key that is the same for connections that frame messages identically. Shall be called from a thread
+	/// of a connection.
+	int framingKind() const;
+
+	/// Switches connection to compact binary framing or back to protocol given in constructor. Binary frame is
+	/// "<0xB7><type><flags><varint payload length><payload>", where flags bit 0 means that payload is compressed by
+	/// qCompress(). Binary frames are always accepted and recognized by the first byte; connection that receives one
+	/// switches to binary framing itself, so a client negotiates binary mode just by sending binary frames.
+	/// @param compress - if true, large messages are compressed when it makes them smaller.
+	Q_INVOKABLE void setBinaryFraming(bool enabled, bool compress = false);
+
+	/// Returns true if connection sends binary frames.
+	bool usesBinaryFraming() const;
+
+	/// Pauses or resumes processing of incoming data. While paused, no new messages are processed and data is left
+	/// in a socket, so TCP flow control slows down a sender. Shall be called from a thread of a connection.
+	void setReadingPaused(bool paused);
+
+	/// Sets sending mode of a connection.
+	/// @param batchWindowMs - 0 for low latency mode (default): Nagle's algorithm is disabled and every message is
+	///        written to a socket immediately. Positive value for throughput mode: messages sent within this number
+	///        of milliseconds are coalesced into one socket write and Nagle's algorithm is left enabled.
+	Q_INVOKABLE void setBatchWindow(int batchWindowMs);
+
+	/// Returns number of messages sent through this connection. Shall be called from a thread of a connection.
+	int sentMessages() const;
+
+	/// Returns number of socket writes made to send messages. Shall be called from a thread of a connection.
+	int socketWrites() const;
+
+signals:
+	/// Emitted when connection is established and its peer address is known.
+	/// @param ip - peer address.
+	/// @param port - peer port.
+	void connected(QHostAddress const &ip, int port);
+
+	/// Emitted once when connection is closed or failed to open (for outgoing connection --- when all reconnection
+	/// attempts failed). Connection object will be deleted by a server after that.
+	void disconnected();
+
 protected:
-	/// Creates socket and initializes outgoing connection, shall be called when Connection is already in its own
-	/// thread.
+	/// Creates socket and starts outgoing connection, shall be called when Connection is already in its working
+	/// thread. Does not wait for connection to be established. If connection fails or is lost later, it is
+	/// reestablished with exponentially growing delays, messages sent meanwhile are queued.
 	/// @param ip - target ip address.
 	/// @param port - target port.
 	void init(QHostAddress const &ip, int port);
 
+	/// Called every time outgoing connection is established or reestablished, before queued messages are sent.
+	/// Can be used to send a handshake. Default implementation does nothing.
+	virtual void onEstablished();
+
+	/// Called when a part of sent data is written to a network, can be used to send more data with flow control.
+	/// Default implementation does nothing.
+	virtual void onBytesWritten();
+
+	/// Returns number of bytes sent but not yet written to a network.
+	qint64 bytesToWrite() const;
+
+	/// Returns type tag of a message being processed by processData(), 0 for messages received by text protocols.
+	int messageType() const;
+
+protected slots:
+	/// Writes all messages accumulated in throughput mode to a socket.
+	void flush();
+
 private slots:
+	/// Outgoing connection is established.
+	void onConnected();
+
+	/// Makes next attempt to establish outgoing connection.
+	void reconnect();
+
+	/// Socket wrote a part of its buffer to a network.
+	void onSocketBytesWritten();
+
 	/// New data is ready on a socket.
 	void onReadyRead();
 
@@ -75,22 +197,107 @@ private slots:
 
 private:
 	/// Processes received data. Shall be implemented in concrete connection classes.
+	/// @param data - received message. It refers to the internal receive buffer without copying, so it is valid only
+	///        during this call, is not null-terminated and shall be copied (for example, by mid() or QByteArray
+	///        constructor) if it is stored or sent to other thread.
 	virtual void processData(QByteArray const &data) = 0;
 
 	void connectSlots();
 
+	/// Extracts all complete messages from mBuffer starting at mReadOffset and passes them to processData(), then
+	/// removes processed data from the buffer at once.
 	void processBuffer();
 
+	/// Parses binary frame at mReadOffset and passes its payload to processData(). Returns false if frame is not
+	/// completely received yet.
+	bool processBinaryFrame();
+
+	/// Returns given message framed according to given text protocol.
+	static QByteArray textFrame(QByteArray const &data, Protocol protocol);
+
+	/// Returns given message in a binary frame.
+	static QByteArray binaryFrame(QByteArray const &data, int type, bool compress);
+
+	/// Discards all received data and closes connection, used when a peer violates the protocol.
+	void dropReceivedData(QString const &reason);
+
+	/// Writes framed message to a socket or adds it to current batch.
+	void write(QByteArray const &frame);
+
+	/// Writes given data containing given number of framed messages to a socket.
+	void writeToSocket(QByteArray const &data, int messages);
+
+	/// Sets socket options according to sending mode.
+	void applySocketOptions();
+
+	/// Emits disconnected() if it was not emitted yet.
+	void reportDisconnect();
+
+	/// Schedules reconnection for outgoing connection or reports disconnect if reconnection is not possible.
+	void onConnectionLost();
+
 	/// Socket for this connection.
 	QScopedPointer<QTcpSocket> mSocket;
 
-	/// Buffer to accumulate parts of a message.
+	/// Buffer to accumulate received data. Data before mReadOffset is already processed.
 	QByteArray mBuffer;
 
-	/// Declared size of a current message.
-	int mExpectedBytes = 0;
+	/// Position of the first not processed byte in mBuffer.
+	int mReadOffset = 0;
+
+	/// Declared size of a current message, or -1 if its length header is not parsed yet.
+	int mExpectedBytes = -1;
+
+	/// True while received messages are being processed, to protect mBuffer from being modified by nested reads.
+	bool mProcessingBuffer = false;
 
 	Protocol mProtocol;
+
+	/// True if messages are sent in binary frames.
+	bool mBinaryFraming = false;
+
+	/// True if large messages in binary frames are compressed.
+	bool mCompression = false;
+
+	/// Type tag of a message being processed.
+	int mMessageType = 0;
+
+	/// Framed messages sent before outgoing connection was established.
+	QList<QByteArray> mPendingMessages;
+
+	/// Target of outgoing connection, null for incoming connections.
+	QHostAddress mTargetIp;
+	int mTargetPort = 0;
+
+	/// Number of failed attempts to establish outgoing connection since it was last established.
+	int mReconnectAttempts = 0;
+
+	/// Fires when it is time for the next reconnection attempt.
+	QTimer mReconnectTimer;
+
+	/// True if processing of incoming data is paused.
+	bool mReadingPaused = false;
+
+	/// Sending mode, see setBatchWindow().
+	int mBatchWindowMs = 0;
+
+	/// Framed messages waiting to be written in throughput mode.
+	QByteArray mBatch;
+
+	/// Number of messages in mBatch.
+	int mBatchMessages = 0;
+
+	/// Fires when batch window is over.
+	QTimer mBatchTimer;
+
+	/// Counters of sent messages and socket writes, to see how well messages are coalesced.
+	int mSentMessages = 0;
+	int mSocketWrites = 0;
+
+	/// True if disconnected() was already emitted.
+	bool mDisconnectReported = false;
 };
 
 }
+
+Q_DECLARE_METATYPE(QSharedPointer<trikKernel::BroadcastMessage>)
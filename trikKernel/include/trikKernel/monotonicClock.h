@@ -0,0 +1,33 @@
+#pragma once
+
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <QtCore/QtGlobal>
+
+namespace trikKernel {
+
+/// Monotonic time source for timestamps and latency measurements, which is not affected by system clock
+/// adjustments (NTP, manual time setting on a robot). Values are comparable between threads of one process only.
+class MonotonicClock
+{
+public:
+	/// Returns number of microseconds since some unspecified point in the past.
+	static qint64 microseconds();
+
+	/// Returns number of milliseconds since some unspecified point in the past.
+	static qint64 milliseconds();
+};
+
+}
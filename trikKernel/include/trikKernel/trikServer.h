@@ -17,18 +17,29 @@
 #include <functional>
 
 #include <QtCore/QHash>
+#include <QtCore/QMultiHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
 #include <QtCore/QThread>
 #include <QtNetwork/QTcpServer>
+#include <QtNetwork/QHostAddress>
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 	typedef int qintptr;
+
+	/// Qt 4 has no hash function for QHostAddress, so providing our own to be able to use it as a key.
+	inline uint qHash(QHostAddress const &key)
+	{
+		return qHash(key.toString());
+	}
 #endif
 
 namespace trikKernel {
 
 class Connection;
 
-/// Server that can handle multiple clients. Actual work is done in separate threads by Connection objects.
+/// Server that can handle multiple clients. Actual work is done by Connection objects, which are distributed among
+/// a fixed pool of threads or all work in a thread of a server, see setConnectionThreadsCount().
 class TrikServer : public QTcpServer
 {
 	Q_OBJECT
@@ -43,31 +54,84 @@ public:
 	/// Starts listening given port on all network interfaces.
 	void startServer(int const &port);
 
-	/// Broadcasts message across all opened connections.
+	/// Broadcasts message across all opened connections. Message is posted to a thread of each connection and framed
+	/// there, once for each framing in use, so connections are never accessed from a foreign thread.
 	void sendMessage(QString const &message);
 
 protected:
 	void incomingConnection(qintptr socketDescriptor) override;
 
-	/// Launches given connection in a separate thread. Takes ownership over connectionWorker object.
+	/// Launches given connection in the least loaded thread of a pool or in a server thread. Takes ownership over
+	/// connectionWorker object.
 	void startConnection(Connection * const connectionWorker);
 
-	/// Searches connection to given IP and port in a list of all open connections. Note that if connection is added
-	/// by startConnection() call but not finished to open yet, it will not be found.
+	/// Sets the maximal number of threads for connections started after this call. Threads are created lazily, when
+	/// all existing ones already serve connections, and live until the server is destroyed, so connecting and
+	/// disconnecting clients does not create and destroy threads. 0 means that connections work in a thread of a
+	/// server, multiplexed on its event loop, which is preferable for servers with lots of long-living lightweight
+	/// connections. Default is the number of processor cores.
+	void setConnectionThreadsCount(int count);
+
+	/// Searches connection to given IP and port among all open connections in constant time. Note that if connection
+	/// is added by startConnection() call but not finished to open yet, it will not be found.
 	Connection *connection(QHostAddress const &ip, int port) const;
 
-	/// Searches connection to given IP and any port in a list of all open connections. Will return arbitrary matching
-	/// connection if there are more than one connection with this IP. Note that if connection is added
-	/// by startConnection() call but not finished to open yet, it will not be found.
+	/// Searches connection to given IP and any port among all open connections in constant time. Will return
+	/// arbitrary matching connection if there are more than one connection with this IP. Note that if connection is
+	/// added by startConnection() call but not finished to open yet, it will not be found.
 	Connection *connection(QHostAddress const &ip) const;
 
+	/// Returns all connections of this server, including not yet opened ones.
+	QList<Connection *> connections() const;
+
 private slots:
-	/// Called when connection thread finishes.
+	/// Called when connection is established, adds it to address indexes.
+	void onConnectionOpened(QHostAddress const &ip, int port);
+
+	/// Called when connection is closed, stops its thread if needed and deletes it.
 	void onConnectionClosed();
 
+	/// Called directly in a thread of a closed connection when it is actually deleted.
+	void onConnectionDestroyed(QObject *connection);
+
 private:
-	/// Maps thread object to corresponding connection worker object, to be able to correctly stop and delete them all.
-	QHash<QThread *, Connection *> mConnections;  // Has ownership over threads and connections.
+	/// Removes connection from address indexes.
+	void removeFromIndexes(Connection * const connection);
+
+	/// Returns the least loaded thread of a pool, creating new one if all threads have connections and pool is not
+	/// full.
+	QThread *pickThread();
+
+	/// Maps connection worker object to its thread. Connections working in a server thread are mapped to nullptr.
+	QHash<Connection *, QThread *> mConnections;  // Has ownership over connections.
+
+	/// Closed connections scheduled for deletion in their threads, mapped to these threads (nullptr for a server
+	/// thread). Connections not deleted by the time server is destroyed are deleted by its destructor.
+	QHash<Connection *, QThread *> mClosedConnections;
+
+	/// Guards mClosedConnections, since connections are deleted in their own threads.
+	QMutex mClosedConnectionsMutex;
+
+	/// Threads for connections, started once and reused.
+	QList<QThread *> mThreads;  // Has ownership.
+
+	/// Number of connections served by each thread of a pool.
+	QHash<QThread *, int> mThreadLoads;
+
+	/// Maximal number of threads in a pool, 0 if connections work in a thread of a server.
+	int mConnectionThreadsCount;
+
+	/// Peer address and port of an open connection.
+	typedef QPair<QHostAddress, int> Address;
+
+	/// Index of open connections by peer address and port.
+	QHash<Address, Connection *> mConnectionsByAddress;
+
+	/// Index of open connections by peer address.
+	QMultiHash<QHostAddress, Connection *> mConnectionsByIp;
+
+	/// Peer addresses of open connections, to be able to remove them from indexes when they are closed.
+	QHash<Connection *, Address> mConnectionAddresses;
 
 	/// Function that provides actual connection objects.
 	std::function<Connection *()> mConnectionFactory;
@@ -13,7 +13,7 @@
  * limitations under the License. */
 
 #include <QtCore/QDebug>
-#include <QtCore/QThread>
+#include <QtCore/QtEndian>
 
 #include "connection.h"
 
@@ -21,9 +21,83 @@
 
 using namespace trikKernel;
 
+/// Maximal number of bytes of a message written to a log.
+int const maxLoggedBytes = 200;
+
+/// Batch is flushed before batch window is over when it reaches this size.
+int const maxBatchSize = 16 * 1024;
+
+/// Delay before first reconnection attempt, doubled on each failed attempt.
+int const initialReconnectDelayMs = 500;
+
+/// Maximal delay between reconnection attempts.
+int const maxReconnectDelayMs = 30000;
+
+/// Number of failed reconnection attempts after which outgoing connection is considered dead.
+int const maxReconnectAttempts = 10;
+
+/// Maximal number of messages queued while outgoing connection is not established, older messages are dropped.
+int const maxPendingMessages = 1000;
+
+/// Maximal size of incoming message. Connection is closed when peer tries to send larger one, so receive buffer
+/// can not grow infinitely.
+int const maxMessageSize = 16 * 1024 * 1024;
+
+/// Maximal number of characters in a length header of a message.
+int const maxLengthHeaderSize = 10;
+
+/// First byte of a binary frame. It can start neither decimal length nor UTF-8 text, since it is a UTF-8
+/// continuation byte.
+uchar const binaryFrameMagic = 0xB7;
+
+/// Size of a binary frame header before varint length: magic, type and flags.
+int const binaryFrameFixedHeaderSize = 3;
+
+/// Maximal size of varint-encoded 32-bit length.
+int const maxVarintSize = 5;
+
+/// Flag of a binary frame meaning that payload is compressed by qCompress().
+uchar const compressedFlag = 0x01;
+
+/// Messages smaller than this are never compressed, compression will not make them smaller anyway.
+int const compressionThreshold = 256;
+
+/// Size of socket read buffer while reading is paused. When it is full, socket stops reading data from OS.
+qint64 const pausedReadBufferSize = 64 * 1024;
+
+BroadcastMessage::BroadcastMessage(QByteArray const &data)
+	: mData(data)
+{
+}
+
+QByteArray BroadcastMessage::frame(Connection const &connection)
+{
+	int const kind = connection.framingKind();
+	{
+		QMutexLocker locker(&mMutex);
+		if (mFrames.contains(kind)) {
+			return mFrames.value(kind);
+		}
+	}
+
+	// Framing outside of a lock, so connections in other threads are not stalled by compression. Two connections may
+	// frame a message concurrently, both frames are identical then.
+	QByteArray const result = connection.frameMessage(mData);
+	QMutexLocker locker(&mMutex);
+	mFrames.insert(kind, result);
+	return result;
+}
+
 Connection::Connection(Protocol connectionProtocol)
 	: mProtocol(connectionProtocol)
+	, mReconnectTimer(this)
+	, mBatchTimer(this)
 {
+	mBatchTimer.setSingleShot(true);
+	connect(&mBatchTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+	mReconnectTimer.setSingleShot(true);
+	connect(&mReconnectTimer, SIGNAL(timeout()), this, SLOT(reconnect()));
 }
 
 QHostAddress Connection::peerAddress() const
@@ -50,38 +124,286 @@ int Connection::peerPort() const
 
 void Connection::init(QHostAddress const &ip, int port)
 {
+	mTargetIp = ip;
+	mTargetPort = port;
+
 	mSocket.reset(new QTcpSocket());
 
 	connectSlots();
 
 	mSocket->connectToHost(ip, port);
+}
+
+void Connection::onEstablished()
+{
+}
+
+void Connection::onBytesWritten()
+{
+}
+
+bool Connection::isConnected() const
+{
+	return mSocket && mSocket->state() == QAbstractSocket::ConnectedState;
+}
+
+qint64 Connection::bytesToWrite() const
+{
+	return (mSocket ? mSocket->bytesToWrite() : 0) + mBatch.size();
+}
+
+void Connection::onSocketBytesWritten()
+{
+	onBytesWritten();
+}
+
+void Connection::reconnect()
+{
+	QLOG_INFO() << "Reconnecting to" << mTargetIp << ":" << mTargetPort << ", attempt" << mReconnectAttempts;
+	qDebug() << "Reconnecting to" << mTargetIp << ":" << mTargetPort << ", attempt" << mReconnectAttempts;
+
+	// Socket is already disconnected, so its signals carry no information, but they shall not trigger one more
+	// reconnection.
+	mSocket->blockSignals(true);
+	mSocket->abort();
+	mSocket->blockSignals(false);
+
+	mBuffer.clear();
+	mReadOffset = 0;
+	mExpectedBytes = -1;
+	mSocket->connectToHost(mTargetIp, mTargetPort);
+}
+
+void Connection::onConnectionLost()
+{
+	if (mTargetIp.isNull() || mDisconnectReported) {
+		reportDisconnect();
+		return;
+	}
+
+	if (mReconnectTimer.isActive()) {
+		// Both error() and disconnected() may be emitted for one failure.
+		return;
+	}
+
+	if (mReconnectAttempts >= maxReconnectAttempts) {
+		QLOG_ERROR() << "Giving up reconnecting to" << mTargetIp << ":" << mTargetPort;
+		qDebug() << "Giving up reconnecting to" << mTargetIp << ":" << mTargetPort;
+		reportDisconnect();
+		return;
+	}
+
+	int const delay = qMin(maxReconnectDelayMs, initialReconnectDelayMs << qMin(mReconnectAttempts, 16));
+	++mReconnectAttempts;
+	mReconnectTimer.start(delay);
+}
+
+QByteArray Connection::frameMessage(QByteArray const &data) const
+{
+	return mBinaryFraming ? binaryFrame(data, 0, mCompression) : textFrame(data, mProtocol);
+}
+
+int Connection::framingKind() const
+{
+	if (mBinaryFraming) {
+		return mCompression ? 3 : 2;
+	}
+
+	return mProtocol == Protocol::messageLength ? 0 : 1;
+}
+
+void Connection::setBinaryFraming(bool enabled, bool compress)
+{
+	mBinaryFraming = enabled;
+	mCompression = compress;
+}
+
+bool Connection::usesBinaryFraming() const
+{
+	return mBinaryFraming;
+}
+
+int Connection::messageType() const
+{
+	return mMessageType;
+}
+
+QByteArray Connection::binaryFrame(QByteArray const &data, int type, bool compress)
+{
+	QByteArray payload = data;
+	uchar flags = 0;
+	if (compress && data.size() >= compressionThreshold) {
+		QByteArray const compressed = qCompress(data);
+		if (compressed.size() < data.size()) {
+			payload = compressed;
+			flags |= compressedFlag;
+		}
+	}
+
+	QByteArray result;
+	result.reserve(binaryFrameFixedHeaderSize + maxVarintSize + payload.size());
+	result.append(static_cast<char>(binaryFrameMagic));
+	result.append(static_cast<char>(type));
+	result.append(static_cast<char>(flags));
+
+	quint32 length = static_cast<quint32>(payload.size());
+	do {
+		uchar byte = length & 0x7f;
+		length >>= 7;
+		if (length != 0) {
+			byte |= 0x80;
+		}
+
+		result.append(static_cast<char>(byte));
+	} while (length != 0);
 
-	if (!mSocket->waitForConnected()) {
-		QLOG_ERROR() << "Connection to" << ip << ":" << port << "failed";
-		qDebug() << "Connection to" << ip << ":" << port << "failed";
-		thread()->quit();
+	result.append(payload);
+	return result;
+}
+
+QByteArray Connection::textFrame(QByteArray const &data, Protocol protocol)
+{
+	QByteArray result;
+	if (protocol == Protocol::messageLength) {
+		QByteArray const length = QByteArray::number(data.size());
+		result.reserve(length.size() + 1 + data.size());
+		result.append(length);
+		result.append(':');
+		result.append(data);
+	} else {
+		result.reserve(data.size() + 1);
+		result.append(data);
+		result.append('\n');
 	}
+
+	return result;
 }
 
 void Connection::send(QByteArray const &data)
 {
+	sendFrame(frameMessage(data));
+}
+
+void Connection::sendTyped(QByteArray const &data, int type)
+{
+	sendFrame(mBinaryFraming ? binaryFrame(data, type, mCompression) : textFrame(data, mProtocol));
+}
+
+void Connection::sendBroadcast(QSharedPointer<BroadcastMessage> const &message)
+{
+	sendFrame(message->frame(*this));
+}
+
+void Connection::sendFrame(QByteArray const &frame)
+{
+	if (!mSocket) {
+		QLOG_ERROR() << "Trying to send through uninitialized connection, message is not delivered";
+		qDebug() << "Trying to send through uninitialized connection, message is not delivered";
+		return;
+	}
+
+	if (mSocket->state() == QAbstractSocket::HostLookupState
+			|| mSocket->state() == QAbstractSocket::ConnectingState
+			|| mReconnectTimer.isActive())
+	{
+		if (mPendingMessages.size() >= maxPendingMessages) {
+			QLOG_ERROR() << "Too many messages wait for connection, oldest message is dropped";
+			qDebug() << "Too many messages wait for connection, oldest message is dropped";
+			mPendingMessages.removeFirst();
+		}
+
+		mPendingMessages.append(frame);
+		return;
+	}
+
 	if (mSocket->state() != QAbstractSocket::ConnectedState) {
 		QLOG_ERROR() << "Trying to send through unconnected socket, message is not delivered";
 		qDebug() << "Trying to send through unconnected socket, message is not delivered";
 		return;
 	}
 
-	QLOG_INFO() << "Sending:" << data << " to" << peerAddress() << ":" << peerPort();
-	qDebug() << "Sending:" << data << " to" << peerAddress() << ":" << peerPort();
+	write(frame);
+}
 
-	QByteArray const message = mProtocol == Protocol::messageLength
-			? QByteArray::number(data.size()) + ':' + data
-			: data + '\n';
+void Connection::write(QByteArray const &frame)
+{
+	// Messages may be large binary chunks, so logging only their beginning.
+	QLOG_INFO() << "Sending:" << frame.left(maxLoggedBytes) << " to" << peerAddress() << ":" << peerPort();
+	qDebug() << "Sending:" << frame.left(maxLoggedBytes) << " to" << peerAddress() << ":" << peerPort();
 
-	qint64 const sentBytes = mSocket->write(message);
-	if (sentBytes != message.size()) {
-		QLOG_ERROR() << "Failed to send message" << message << ", " << sentBytes << "sent.";
-		qDebug() << "Failed to send message" << message << ", " << sentBytes << "sent.";
+	if (mBatchWindowMs == 0 && mBatch.isEmpty()) {
+		// Nothing to coalesce with, writing frame as is, without copying it into a batch.
+		writeToSocket(frame, 1);
+		return;
+	}
+
+	mBatch.append(frame);
+	++mBatchMessages;
+
+	if (mBatchWindowMs == 0 || mBatch.size() >= maxBatchSize) {
+		flush();
+	} else if (!mBatchTimer.isActive()) {
+		mBatchTimer.start(mBatchWindowMs);
+	}
+}
+
+void Connection::flush()
+{
+	mBatchTimer.stop();
+	if (mBatch.isEmpty()) {
+		return;
+	}
+
+	writeToSocket(mBatch, mBatchMessages);
+
+	mBatch.clear();
+	mBatchMessages = 0;
+}
+
+void Connection::writeToSocket(QByteArray const &data, int messages)
+{
+	if (!mSocket || mSocket->state() != QAbstractSocket::ConnectedState) {
+		QLOG_ERROR() << "Connection closed," << messages << "messages are not delivered";
+		qDebug() << "Connection closed," << messages << "messages are not delivered";
+		return;
+	}
+
+	qint64 const sentBytes = mSocket->write(data);
+	if (sentBytes != data.size()) {
+		QLOG_ERROR() << "Failed to send" << messages << "messages," << sentBytes << "of" << data.size()
+				<< "bytes sent.";
+		qDebug() << "Failed to send" << messages << "messages," << sentBytes << "of" << data.size()
+				<< "bytes sent.";
+	}
+
+	mSentMessages += messages;
+	++mSocketWrites;
+}
+
+void Connection::setBatchWindow(int batchWindowMs)
+{
+	mBatchWindowMs = qMax(0, batchWindowMs);
+	if (mBatchWindowMs == 0) {
+		flush();
+	}
+
+	applySocketOptions();
+}
+
+int Connection::sentMessages() const
+{
+	return mSentMessages;
+}
+
+int Connection::socketWrites() const
+{
+	return mSocketWrites;
+}
+
+void Connection::applySocketOptions()
+{
+	if (mSocket && mSocket->state() == QAbstractSocket::ConnectedState) {
+		mSocket->setSocketOption(QAbstractSocket::LowDelayOption, mBatchWindowMs == 0 ? 1 : 0);
 	}
 }
 
@@ -92,76 +414,242 @@ void Connection::init(int socketDescriptor)
 	if (!mSocket->setSocketDescriptor(socketDescriptor)) {
 		QLOG_ERROR() << "Failed to set socket descriptor" << socketDescriptor;
 		qDebug() << "Failed to set socket descriptor" << socketDescriptor;
+		reportDisconnect();
 		return;
 	}
 
+	applySocketOptions();
 	connectSlots();
+
+	emit connected(peerAddress(), peerPort());
+}
+
+void Connection::onConnected()
+{
+	QLOG_INFO() << "Connected to" << peerAddress() << ":" << peerPort();
+	qDebug() << "Connected to" << peerAddress() << ":" << peerPort();
+
+	mReconnectAttempts = 0;
+
+	emit connected(peerAddress(), peerPort());
+
+	applySocketOptions();
+	onEstablished();
+
+	for (QByteArray const &message : mPendingMessages) {
+		write(message);
+	}
+
+	mPendingMessages.clear();
+}
+
+void Connection::setReadingPaused(bool paused)
+{
+	if (mReadingPaused == paused) {
+		return;
+	}
+
+	mReadingPaused = paused;
+	if (!mSocket) {
+		return;
+	}
+
+	if (paused) {
+		mSocket->setReadBufferSize(pausedReadBufferSize);
+	} else {
+		mSocket->setReadBufferSize(0);
+
+		// Processing messages that are already in a buffer and data that arrived while we were paused.
+		onReadyRead();
+	}
 }
 
 void Connection::onReadyRead()
 {
-	if (!mSocket || !mSocket->isValid()) {
+	if (!mSocket || !mSocket->isValid() || mReadingPaused || mProcessingBuffer) {
 		return;
 	}
 
-	QByteArray const &data = mSocket->readAll();
-	mBuffer.append(data);
+	mProcessingBuffer = true;
 
-	QLOG_INFO() << "Received from" << peerAddress() << ":" << peerPort() << ":" << mBuffer;
-	qDebug() << "Received from" << peerAddress() << ":" << peerPort() << ":" << mBuffer;
+	// Data that arrives while messages are processed does not trigger readyRead() again, so reading until socket is
+	// empty.
+	do {
+		int const oldSize = mBuffer.size();
+		int const available = static_cast<int>(mSocket->bytesAvailable());
+		if (available > 0) {
+			// Reading directly into a buffer, without intermediate QByteArray.
+			mBuffer.resize(oldSize + available);
+			int const bytesRead = static_cast<int>(mSocket->read(mBuffer.data() + oldSize, available));
+			mBuffer.resize(oldSize + qMax(0, bytesRead));
 
-	processBuffer();
+			QByteArray const received = QByteArray::fromRawData(mBuffer.constData() + oldSize
+					, qMin(mBuffer.size() - oldSize, maxLoggedBytes));
+
+			QLOG_INFO() << "Received from" << peerAddress() << ":" << peerPort() << ":" << received;
+			qDebug() << "Received from" << peerAddress() << ":" << peerPort() << ":" << received;
+		}
+
+		processBuffer();
+	} while (mSocket && !mReadingPaused && mSocket->bytesAvailable() > 0);
+
+	mProcessingBuffer = false;
 }
 
 void Connection::processBuffer()
 {
-	switch (mProtocol) {
-	case Protocol::messageLength:
-	{
-		while (!mBuffer.isEmpty()) {
-			if (mExpectedBytes == 0) {
+	// Messages are passed to processData() as views into mBuffer, so it is not modified until all of them are
+	// processed. Empty message is complete as soon as its header is parsed, even if nothing follows it.
+	while (!mReadingPaused && (mReadOffset < mBuffer.size() || mExpectedBytes == 0)) {
+		if (mExpectedBytes == -1 && static_cast<uchar>(mBuffer.at(mReadOffset)) == binaryFrameMagic) {
+			if (!processBinaryFrame()) {
+				break;
+			}
+		} else if (mProtocol == Protocol::messageLength) {
+			if (mExpectedBytes == -1) {
 				// Determining the length of a message.
-				int const delimiterIndex = mBuffer.indexOf(':');
+				int const delimiterIndex = mBuffer.indexOf(':', mReadOffset);
 				if (delimiterIndex == -1) {
+					if (mBuffer.size() - mReadOffset > maxLengthHeaderSize) {
+						dropReceivedData("message length header is too long");
+						return;
+					}
+
 					// We did not receive full message length yet.
+					break;
+				}
+
+				QByteArray const length = QByteArray::fromRawData(mBuffer.constData() + mReadOffset
+						, delimiterIndex - mReadOffset);
+
+				bool ok = false;
+				mExpectedBytes = length.toInt(&ok);
+				if (!ok || mExpectedBytes < 0) {
+					QLOG_ERROR() << "Malformed message, can not determine message length from this:" << length;
+					qDebug() << "Malformed message, can not determine message length from this:" << length;
+					mExpectedBytes = -1;
+				} else if (mExpectedBytes > maxMessageSize) {
+					dropReceivedData(QString("message of %1 bytes is too large").arg(mExpectedBytes));
 					return;
-				} else {
-					QByteArray const length = mBuffer.left(delimiterIndex);
-					mBuffer = mBuffer.mid(delimiterIndex + 1);
-					bool ok;
-					mExpectedBytes = length.toInt(&ok);
-					if (!ok) {
-						qDebug() << "Malformed message, can not determine message length from this:" << length;
-						mExpectedBytes = 0;
-					}
 				}
-			} else {
-				if (mBuffer.size() >= mExpectedBytes) {
-					QByteArray const message = mBuffer.left(mExpectedBytes);
-					mBuffer = mBuffer.mid(mExpectedBytes);
 
-					processData(message);
+				mReadOffset = delimiterIndex + 1;
+			} else if (mBuffer.size() - mReadOffset >= mExpectedBytes) {
+				QByteArray const message = QByteArray::fromRawData(mBuffer.constData() + mReadOffset
+						, mExpectedBytes);
 
-					mExpectedBytes = 0;
-				} else {
-					// We don't have all message yet.
+				mReadOffset += mExpectedBytes;
+				mExpectedBytes = -1;
+
+				mMessageType = 0;
+				processData(message);
+			} else {
+				// We don't have all message yet.
+				break;
+			}
+		} else {
+			int const separatorIndex = mBuffer.indexOf('\n', mReadOffset);
+			if (separatorIndex == -1) {
+				if (mBuffer.size() - mReadOffset > maxMessageSize) {
+					dropReceivedData("no end of line found, message is too large");
 					return;
 				}
+
+				break;
 			}
+
+			QByteArray const message = QByteArray::fromRawData(mBuffer.constData() + mReadOffset
+					, separatorIndex - mReadOffset);
+
+			mReadOffset = separatorIndex + 1;
+
+			mMessageType = 0;
+			processData(message);
 		}
 	}
-	case Protocol::endOfLineSeparator:
-	{
-		if (mBuffer.contains('\n')) {
-			auto const messages = mBuffer.split('\n');
-			for (int i = 0; i < messages.size() - 1; ++i) {
-				processData(messages.at(i));
-			}
 
-			mBuffer = messages.last();
+	// Compacting buffer once per read, so each received byte is moved at most once.
+	if (mReadOffset >= mBuffer.size()) {
+		mBuffer.clear();
+		mReadOffset = 0;
+	} else if (mReadOffset > 0) {
+		mBuffer.remove(0, mReadOffset);
+		mReadOffset = 0;
+	}
+}
+
+bool Connection::processBinaryFrame()
+{
+	int const available = mBuffer.size() - mReadOffset;
+	uchar const * const frame = reinterpret_cast<uchar const *>(mBuffer.constData() + mReadOffset);
+
+	quint32 length = 0;
+	int position = binaryFrameFixedHeaderSize;
+	for (int shift = 0; ; shift += 7) {
+		if (position >= available) {
+			// Header is not received completely yet.
+			return false;
 		}
+
+		if (position - binaryFrameFixedHeaderSize == maxVarintSize) {
+			dropReceivedData("malformed length of a binary frame");
+			return true;
+		}
+
+		uchar const byte = frame[position++];
+		length |= static_cast<quint32>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+
+	if (length > static_cast<quint32>(maxMessageSize)) {
+		dropReceivedData(QString("binary frame of %1 bytes is too large").arg(length));
+		return true;
+	}
+
+	if (static_cast<quint32>(available - position) < length) {
+		return false;
+	}
+
+	QByteArray const payload = QByteArray::fromRawData(mBuffer.constData() + mReadOffset + position
+			, static_cast<int>(length));
+
+	uchar const flags = frame[2];
+	mMessageType = frame[1];
+	mReadOffset += position + static_cast<int>(length);
+
+	// Peer speaks binary protocol, so answering the same way.
+	mBinaryFraming = true;
+
+	if ((flags & compressedFlag) == 0) {
+		processData(payload);
+		return true;
 	}
+
+	// qCompress() stores uncompressed size in the first 4 bytes, checking it to not be fooled into allocating
+	// huge buffer.
+	if (length < 4 || qFromBigEndian<quint32>(frame + position) > static_cast<quint32>(maxMessageSize)) {
+		QLOG_ERROR() << "Malformed compressed frame from" << peerAddress() << ":" << peerPort() << ", ignoring";
+		qDebug() << "Malformed compressed frame from" << peerAddress() << ":" << peerPort() << ", ignoring";
+		return true;
 	}
+
+	processData(qUncompress(payload));
+	return true;
+}
+
+void Connection::dropReceivedData(QString const &reason)
+{
+	QLOG_ERROR() << "Closing connection to" << peerAddress() << ":" << peerPort() << "," << reason;
+	qDebug() << "Closing connection to" << peerAddress() << ":" << peerPort() << "," << reason;
+
+	mBuffer.clear();
+	mReadOffset = 0;
+	mExpectedBytes = -1;
+
+	// Stream can not be resynchronized, so closing connection, socket will report disconnection.
+	mSocket->abort();
 }
 
 void Connection::onDisconnect()
@@ -169,7 +657,7 @@ void Connection::onDisconnect()
 	QLOG_INFO() << "Connection" << mSocket->socketDescriptor() << "disconnected.";
 	qDebug() << "Connection" << mSocket->socketDescriptor() << "disconnected.";
 
-	thread()->quit();
+	onConnectionLost();
 }
 
 void Connection::onError(QAbstractSocket::SocketError error)
@@ -184,12 +672,28 @@ void Connection::onError(QAbstractSocket::SocketError error)
 		qDebug() << "Connection" << mSocket->socketDescriptor() << "errored.";
 	}
 
-	thread()->quit();
+	onConnectionLost();
+}
+
+void Connection::reportDisconnect()
+{
+	if (!mDisconnectReported) {
+		mDisconnectReported = true;
+		if (!mPendingMessages.isEmpty()) {
+			QLOG_ERROR() << "Connection failed," << mPendingMessages.size() << "queued messages are not delivered";
+			qDebug() << "Connection failed," << mPendingMessages.size() << "queued messages are not delivered";
+			mPendingMessages.clear();
+		}
+
+		emit disconnected();
+	}
 }
 
 void Connection::connectSlots()
 {
+	connect(mSocket.data(), SIGNAL(connected()), this, SLOT(onConnected()));
 	connect(mSocket.data(), SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	connect(mSocket.data(), SIGNAL(bytesWritten(qint64)), this, SLOT(onSocketBytesWritten()));
 	connect(mSocket.data(), SIGNAL(disconnected()), this, SLOT(onDisconnect()));
 	connect(mSocket.data(), SIGNAL(error(QAbstractSocket::SocketError))
 			, this, SLOT(onError(QAbstractSocket::SocketError)));
@@ -17,28 +17,51 @@
 #include "trikKernel/connection.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QSet>
 
 #include "QsLog.h"
 
 using namespace trikKernel;
 
 TrikServer::TrikServer(std::function<Connection *()> const &connectionFactory)
-	: mConnectionFactory(connectionFactory)
+	: mConnectionThreadsCount(qMax(1, QThread::idealThreadCount()))
+	, mConnectionFactory(connectionFactory)
 {
+	qRegisterMetaType<QHostAddress>("QHostAddress");
+	qRegisterMetaType<QSharedPointer<BroadcastMessage>>("QSharedPointer<trikKernel::BroadcastMessage>");
 }
 
 TrikServer::~TrikServer()
 {
-	for (QThread *thread : mConnections.keys()) {
+	QSet<QThread *> stoppedThreads;
+	for (QThread * const thread : mThreads) {
 		thread->quit();
-		if (!thread->wait(1000)) {
+		if (thread->wait(1000)) {
+			stoppedThreads.insert(thread);
+		} else {
 			QLOG_ERROR() << "Unable to stop thread" << thread;
 			qDebug() << "Unable to stop thread" << thread;
 		}
 	}
 
-	qDeleteAll(mConnections);
 	qDeleteAll(mConnections.keys());
+
+	// Closed connections whose deferred deletion did not happen before their threads stopped are deleted here. Their
+	// threads do not run anymore, so it is safe to do it from this thread. Connections of a thread that failed to
+	// stop may still be used by it, so they are left as is.
+	QMutexLocker locker(&mClosedConnectionsMutex);
+	for (Connection * const connection : mClosedConnections.keys()) {
+		QThread * const thread = mClosedConnections.value(connection);
+		if (!thread || stoppedThreads.contains(thread)) {
+			disconnect(connection, SIGNAL(destroyed(QObject *)), this, SLOT(onConnectionDestroyed(QObject *)));
+			delete connection;
+		}
+	}
+
+	mClosedConnections.clear();
+	locker.unlock();
+
+	qDeleteAll(mThreads);
 }
 
 void TrikServer::startServer(int const &port)
@@ -54,8 +77,12 @@ void TrikServer::startServer(int const &port)
 
 void TrikServer::sendMessage(QString const &message)
 {
-	for (Connection * const connection : mConnections.values()) {
-		connection->send(message.toUtf8());
+	// Connections may switch framing in their threads at any moment, so message is framed there, but only once for
+	// each framing in use, since connections share it.
+	QSharedPointer<BroadcastMessage> const broadcast(new BroadcastMessage(message.toUtf8()));
+	for (Connection * const connection : mConnections.keys()) {
+		QMetaObject::invokeMethod(connection, "sendBroadcast"
+				, Q_ARG(QSharedPointer<trikKernel::BroadcastMessage>, broadcast));
 	}
 }
 
@@ -72,46 +99,124 @@ void TrikServer::incomingConnection(qintptr socketDescriptor)
 
 void TrikServer::startConnection(Connection * const connectionWorker)
 {
-	QThread * const connectionThread = new QThread();
+	connect(connectionWorker, SIGNAL(connected(QHostAddress, int))
+			, this, SLOT(onConnectionOpened(QHostAddress, int)));
+	connect(connectionWorker, SIGNAL(disconnected()), this, SLOT(onConnectionClosed()));
+
+	if (mConnectionThreadsCount == 0) {
+		// Parent is needed for a connection to follow a server if the server is moved to another thread.
+		connectionWorker->setParent(this);
+		mConnections.insert(connectionWorker, nullptr);
+		return;
+	}
 
-	connect(connectionThread, SIGNAL(finished()), connectionThread, SLOT(deleteLater()));
-	connect(connectionThread, SIGNAL(finished()), this, SLOT(onConnectionClosed()));
+	QThread * const connectionThread = pickThread();
 
 	connectionWorker->moveToThread(connectionThread);
 
-	mConnections.insert(connectionThread, connectionWorker);
-
-	connectionThread->start();
+	mConnections.insert(connectionWorker, connectionThread);
+	++mThreadLoads[connectionThread];
 }
 
-Connection *TrikServer::connection(QHostAddress const &ip, int port) const
+QThread *TrikServer::pickThread()
 {
-	for (auto *connection : mConnections.values()) {
-		if (connection->peerAddress() == ip && connection->peerPort() == port) {
-			return connection;
+	QThread *result = nullptr;
+	for (QThread * const thread : mThreads) {
+		if (result == nullptr || mThreadLoads.value(thread) < mThreadLoads.value(result)) {
+			result = thread;
 		}
 	}
 
-	return nullptr;
+	if ((result == nullptr || mThreadLoads.value(result) > 0) && mThreads.size() < mConnectionThreadsCount) {
+		result = new QThread();
+		mThreads.append(result);
+		mThreadLoads.insert(result, 0);
+		result->start();
+	}
+
+	return result;
+}
+
+void TrikServer::setConnectionThreadsCount(int count)
+{
+	mConnectionThreadsCount = qMax(0, count);
+}
+
+Connection *TrikServer::connection(QHostAddress const &ip, int port) const
+{
+	return mConnectionsByAddress.value(qMakePair(ip, port), nullptr);
 }
 
 Connection *TrikServer::connection(QHostAddress const &ip) const
 {
-	for (auto *connection : mConnections.values()) {
-		if (connection->peerAddress() == ip) {
-			return connection;
-		}
+	return mConnectionsByIp.value(ip, nullptr);
+}
+
+QList<Connection *> TrikServer::connections() const
+{
+	return mConnections.keys();
+}
+
+void TrikServer::onConnectionOpened(QHostAddress const &ip, int port)
+{
+	Connection * const connection = static_cast<Connection *>(sender());
+	if (!mConnections.contains(connection)) {
+		return;
 	}
 
-	return nullptr;
+	// Outgoing connections may be reestablished, so removing old address first.
+	removeFromIndexes(connection);
+
+	Address const address(ip, port);
+	mConnectionAddresses.insert(connection, address);
+	mConnectionsByAddress.insert(address, connection);
+	mConnectionsByIp.insert(ip, connection);
+}
+
+void TrikServer::removeFromIndexes(Connection * const connection)
+{
+	if (mConnectionAddresses.contains(connection)) {
+		Address const address = mConnectionAddresses.take(connection);
+		if (mConnectionsByAddress.value(address) == connection) {
+			mConnectionsByAddress.remove(address);
+		}
+
+		mConnectionsByIp.remove(address.first, connection);
+	}
 }
 
 void TrikServer::onConnectionClosed()
 {
-	QThread * const thread = static_cast<QThread *>(sender());
+	Connection * const connection = static_cast<Connection *>(sender());
+	if (!mConnections.contains(connection)) {
+		return;
+	}
+
+	QThread * const thread = mConnections.take(connection);
+	removeFromIndexes(connection);
+
+	if (thread) {
+		// Thread stays in a pool for future connections.
+		--mThreadLoads[thread];
+	}
 
-	// Thread shall already be finished here.
-	delete mConnections.value(thread);
+	// Remembering connection until it is actually deleted, so it will not leak if server is destroyed before.
+	{
+		QMutexLocker locker(&mClosedConnectionsMutex);
+		mClosedConnections.insert(connection, thread);
+	}
+
+	connect(connection, SIGNAL(destroyed(QObject *)), this, SLOT(onConnectionDestroyed(QObject *))
+			, Qt::DirectConnection);
 
-	mConnections.remove(thread);
+	// We may be called from socket signal handler of this connection, or connection may work in other thread, so
+	// deleting it later in its own thread.
+	connection->deleteLater();
+}
+
+void TrikServer::onConnectionDestroyed(QObject *connection)
+{
+	// Called directly in a thread of a connection, so only mutex-guarded set of closed connections is touched here.
+	QMutexLocker locker(&mClosedConnectionsMutex);
+	mClosedConnections.remove(static_cast<Connection *>(connection));
 }
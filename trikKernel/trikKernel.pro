@@ -23,12 +23,14 @@ HEADERS += \
 	$$PWD/include/trikKernel/connection.h \
 	$$PWD/include/trikKernel/debug.h \
 	$$PWD/include/trikKernel/fileUtils.h \
+	$$PWD/include/trikKernel/monotonicClock.h \
 	$$PWD/include/trikKernel/trikServer.h \
 
 SOURCES += \
 	$$PWD/src/connection.cpp \
 	$$PWD/src/debug.cpp \
 	$$PWD/src/fileUtils.cpp \
+	$$PWD/src/monotonicClock.cpp \
 	$$PWD/src/trikServer.cpp \
 
 TEMPLATE = lib
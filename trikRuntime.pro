@@ -24,6 +24,7 @@ SUBDIRS = \
 	trikGui \
 	trikWiFi \
 	trikTelemetry \
+	trikKernel/benchmark/connectionBenchmark.pro \
 	qslog/QsLogSharedLibrary.pro \
 
 trikScriptRunner.depends = trikControl trikKernel qslog/QsLogSharedLibrary.pro
@@ -34,3 +35,4 @@ trikGui.depends = trikCommunicator trikScriptRunner trikWiFi trikKernel trikTele
 trikTelemetry.depends = trikControl trikKernel qslog/QsLogSharedLibrary.pro
 trikControl.depends = qslog/QsLogSharedLibrary.pro
 trikKernel.depends = qslog/QsLogSharedLibrary.pro
+trikKernel/benchmark/connectionBenchmark.pro.depends = trikKernel qslog/QsLogSharedLibrary.pro
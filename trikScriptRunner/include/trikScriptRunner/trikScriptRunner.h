@@ -21,6 +21,7 @@
 
 namespace trikScriptRunner {
 
+class ScriptCache;
 class ScriptRunnerProxy;
 
 /// Executes scripts in Qt Scripting Engine.
@@ -42,6 +43,17 @@ public:
 	/// Returns name of the directory in which scripts must be saved
 	QString scriptsDirName() const;
 
+	/// Prepares script from a given file for execution (reads it, checks syntax and so on), so it starts faster when
+	/// it is run by runFile(). Shall be called when a script file is saved. Thread-safe, can be called directly
+	/// from another thread. Files that are not scripts (by extension) are ignored.
+	/// @param filePath - path to a script file.
+	void cacheScript(QString const &filePath);
+
+	/// Sets time an aborted script is given to stop. If it is still running after that (for example, stuck in
+	/// a native call), motors are powered off forcibly. Default is taken from "scriptRunner" element of config.xml.
+	/// @param milliseconds - abort deadline in milliseconds.
+	void setAbortDeadline(int milliseconds);
+
 public slots:
 	/// Executes given script asynchronously. If some script is already executing, it will be aborted (but no
 	/// completed() signal will be sent for it). Execution state will be reset (and robot fully stopped) before and
@@ -58,6 +70,12 @@ public slots:
 
 	void run(QString const &script);
 
+	/// Executes script from a given file asynchronously, the same way as run(). Prepared script is taken from
+	/// a cache if file was not changed since it was cached (see cacheScript()).
+	/// @param filePath - path to a script file.
+	/// @param fileName - name of a script reported by startedScript() signal.
+	void runFile(QString const &filePath, QString const &fileName);
+
 	/// Executes given script as direct command, so it will use existing script execution environment (or create one
 	/// if needed) and will not reset execution state before or after execution. Sequence of direct commands counts
 	/// as finished when one of them directly requests to quit (by brick.quit() command), then robot will be stopped,
@@ -67,7 +85,7 @@ public slots:
 
 	/// Aborts script execution. completed() signal will be emitted when script will be actually aborted, robot will
 	/// be stopped and execution state will be reset. Note that direct commands and scripts in event-driven mode will
-	/// be stopped as well.
+	/// be stopped as well. Does not wait for a script to stop, aborted() signal is emitted when it stops.
 	void abort();
 
 	/// Plays "beep" sound.
@@ -85,10 +103,17 @@ signals:
 
 	void startedDirectScript(int scriptId);
 
+	/// Emitted when aborted script actually stopped.
+	/// @param latency - time in milliseconds from abort request to a moment when script stopped.
+	void aborted(int latency);
+
 private slots:
 	void onScriptStart(int scriptId);
 
 private:
+	/// Prepared script files, shared with script engine thread.
+	QScopedPointer<ScriptCache> mScriptCache;
+
 	/// Proxy for script engine thread.
 	QScopedPointer<ScriptRunnerProxy> mScriptRunnerProxy;
 
@@ -0,0 +1,140 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "scriptCache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegExp>
+#include <QtScript/QScriptEngine>
+
+#include "QsLog.h"
+
+using namespace trikScriptRunner;
+
+/// Function execution of a script file starts with.
+QString const mainFunction = "main";
+
+/// Resolution of file modification time. Qt 4 reports it with one second precision, so a file changed twice within
+/// a second may keep the same modification time.
+qint64 const modificationTimeResolutionMs = 1000;
+
+/// Maximal number of cached scripts.
+int const maxEntries = 64;
+
+ScriptCache::Entry ScriptCache::update(QString const &filePath)
+{
+	Entry result;
+
+	// Taking time before reading file attributes, so a change made while file is being read is not missed.
+	result.hashed = QDateTime::currentDateTime();
+	result.used = result.hashed;
+	QFileInfo const fileInfo(filePath);
+	result.lastModified = fileInfo.lastModified();
+	result.size = fileInfo.size();
+
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		QLOG_ERROR() << "Failed to open file" << filePath << "for reading";
+		result.error = QObject::tr("Can not read file %1").arg(filePath);
+
+		QMutexLocker locker(&mMutex);
+		mEntries.remove(filePath);
+		return result;
+	}
+
+	QByteArray const contents = file.readAll();
+	result.hash = QCryptographicHash::hash(contents, QCryptographicHash::Sha1);
+
+	{
+		QMutexLocker locker(&mMutex);
+		auto cached = mEntries.find(filePath);
+		if (cached != mEntries.end() && cached->hash == result.hash) {
+			cached->lastModified = result.lastModified;
+			cached->size = result.size;
+			cached->hashed = result.hashed;
+			cached->used = result.used;
+			return *cached;
+		}
+	}
+
+	result.script = QString::fromUtf8(contents.constData(), contents.size());
+
+	QScriptSyntaxCheckResult const syntaxCheck = QScriptEngine::checkSyntax(result.script);
+	if (syntaxCheck.state() != QScriptSyntaxCheckResult::Valid) {
+		result.error = QObject::tr("Line %1: %2").arg(QString::number(syntaxCheck.errorLineNumber())
+				, syntaxCheck.errorMessage());
+	}
+
+	result.program = QScriptProgram(needCallFunction(result.script, mainFunction)
+					? QString("%1\n%2();").arg(result.script, mainFunction)
+					: result.script
+			, fileInfo.fileName());
+
+	QMutexLocker locker(&mMutex);
+	insert(filePath, result);
+	return result;
+}
+
+ScriptCache::Entry ScriptCache::entry(QString const &filePath)
+{
+	QFileInfo const fileInfo(filePath);
+
+	{
+		QMutexLocker locker(&mMutex);
+		auto const cached = mEntries.find(filePath);
+		if (cached != mEntries.end()) {
+			if (!fileInfo.exists()) {
+				mEntries.erase(cached);
+			} else {
+				bool const isUnchanged = cached->lastModified == fileInfo.lastModified()
+						&& cached->size == fileInfo.size();
+				bool const isReliable = cached->lastModified.msecsTo(cached->hashed) > modificationTimeResolutionMs;
+				if (isUnchanged && isReliable) {
+					cached->used = QDateTime::currentDateTime();
+					return *cached;
+				}
+			}
+		}
+	}
+
+	// Either file is changed, or it is not cached, or modification time can not be trusted. In the last case
+	// update() hashes contents and keeps cached entry if they are the same.
+	return update(filePath);
+}
+
+void ScriptCache::insert(QString const &filePath, Entry const &entry)
+{
+	if (!mEntries.contains(filePath) && mEntries.size() >= maxEntries) {
+		auto leastRecentlyUsed = mEntries.begin();
+		for (auto cached = mEntries.begin(); cached != mEntries.end(); ++cached) {
+			if (cached->used < leastRecentlyUsed->used) {
+				leastRecentlyUsed = cached;
+			}
+		}
+
+		mEntries.erase(leastRecentlyUsed);
+	}
+
+	mEntries.insert(filePath, entry);
+}
+
+bool ScriptCache::needCallFunction(QString const &script, QString const &function)
+{
+	QRegExp const functionRegexp(QString(
+			"(.*%1\\s*=\\s*\\w*\\s*function\\(.*\\).*)|(.*function\\s+%1\\s*\\(.*\\).*)").arg(function));
+
+	return !function.isEmpty() && functionRegexp.exactMatch(script) && !script.trimmed().endsWith(function + "();");
+}
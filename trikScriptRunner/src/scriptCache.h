@@ -0,0 +1,80 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtScript/QScriptProgram>
+
+namespace trikScriptRunner {
+
+/// Cache of scripts prepared for execution, keyed by file path and content hash. Preparing a script means reading
+/// it, checking its syntax and deciding whether a call of main function shall be appended to it, so running a
+/// cached script goes straight to evaluation. Entries of deleted files are evicted, and the number of entries is
+/// limited, least recently used ones are evicted first. Thread-safe.
+class ScriptCache
+{
+public:
+	/// Script prepared for execution.
+	struct Entry {
+		/// Script text as it is in a file.
+		QString script;
+
+		/// Program to evaluate, with a call of main function appended if needed.
+		QScriptProgram program;
+
+		/// Localized syntax error or error reading a file, empty if script can be evaluated.
+		QString error;
+
+		/// SHA-1 hash of file contents.
+		QByteArray hash;
+
+		/// File modification time and size when it was prepared, used to detect changed files without reading them.
+		QDateTime lastModified;
+		qint64 size = 0;
+
+		/// Time when file contents were last hashed. If file was modified shortly before that, modification time
+		/// can not tell later changes from this one, so contents are hashed again on each request.
+		QDateTime hashed;
+
+		/// Time when entry was last requested, used to evict least recently used entries.
+		QDateTime used;
+	};
+
+	/// Prepares a script from a given file and puts it into a cache. If cached script has the same contents, it is
+	/// kept as is. Called when a file is uploaded, so it is ready when it is asked to run.
+	/// @param filePath - path to a script file.
+	Entry update(QString const &filePath);
+
+	/// Returns prepared script from a given file. File is prepared again only if it was changed since it was cached.
+	/// If file modification time is too close to the time it was cached to be reliable, contents are hashed again
+	/// and compared to the cached ones.
+	/// @param filePath - path to a script file.
+	Entry entry(QString const &filePath);
+
+	/// Returns true if a script defines a given function and does not call it itself, so a call shall be appended.
+	static bool needCallFunction(QString const &script, QString const &function);
+
+private:
+	/// Puts entry into a cache, evicting least recently used one if cache is full. Shall be called with mMutex locked.
+	void insert(QString const &filePath, Entry const &entry);
+
+	QHash<QString, Entry> mEntries;
+	QMutex mMutex;
+};
+
+}
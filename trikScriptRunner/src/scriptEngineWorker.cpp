@@ -19,6 +19,7 @@
 #include <QtCore/QVector>
 
 #include <trikKernel/fileUtils.h>
+#include <trikKernel/monotonicClock.h>
 
 #include <trikControl/analogSensor.h>
 #include <trikControl/battery.h>
@@ -58,14 +59,24 @@ Q_DECLARE_METATYPE(Sensor3d*)
 Q_DECLARE_METATYPE(QVector<int>)
 Q_DECLARE_METATYPE(QTimer*)
 
-ScriptEngineWorker::ScriptEngineWorker(trikControl::Brick &brick, QString const &startDirPath)
+ScriptEngineWorker::ScriptEngineWorker(trikControl::Brick &brick, QString const &startDirPath
+		, ScriptCache &scriptCache)
 	: mEngine(nullptr)
 	, mBrick(brick)
 	, mThreadingVariable(*this)
 	, mStartDirPath(startDirPath)
-	, mEngineReset(false)
+	, mScriptCache(scriptCache)
 {
 	connect(&mBrick, SIGNAL(quitSignal()), this, SLOT(onScriptRequestingToQuit()));
+
+	if (QFile::exists(mStartDirPath + "system.js")) {
+		mSystemScript = trikKernel::FileUtils::readFromFile(mStartDirPath + "system.js");
+	}
+}
+
+ScriptEngineWorker::~ScriptEngineWorker()
+{
+	delete mStandbyEngine;
 }
 
 void ScriptEngineWorker::brickBeep()
@@ -75,6 +86,8 @@ void ScriptEngineWorker::brickBeep()
 
 void ScriptEngineWorker::reset()
 {
+	// Locks are never nested here, forceStop() takes mAbortMutex first and mEngineMutex inside it.
+	QMutexLocker engineLocker(&mEngineMutex);
 	if (!mEngine) {
 		QLOG_FATAL() << "ScriptEngine is null on reset";
 		Q_ASSERT(false);
@@ -83,28 +96,95 @@ void ScriptEngineWorker::reset()
 	QLOG_INFO() << "ScriptEngineWorker: reset started, current script engine:" << mEngine
 			<< ", thread:" << QThread::currentThread();
 
-	mEngineReset = !mEngine->isEvaluating();
+	bool const isEvaluating = mEngine->isEvaluating();
+	engineLocker.unlock();
+
 	bool const inEventDrivenMode = mBrick.isInEventDrivenMode();
+	if (inEventDrivenMode || isEvaluating) {
+		QMutexLocker locker(&mAbortMutex);
+		if (mAbortStartTime == -1) {
+			mAbortStartTime = trikKernel::MonotonicClock::microseconds();
+		}
+	}
 
 	emit abortEvaluation();
+
+	engineLocker.relock();
 	mEngine->abortEvaluation(QScriptValue("aborted"));
+	engineLocker.unlock();
+
 	mBrick.reset();
-	while (!mEngineReset) {
-		QThread::yieldCurrentThread();
-	}
 
+	// Evaluating script is finished by run() when evaluation is aborted, event-driven one is finished in worker
+	// thread too, after events that are already queued there. Caller does not wait for any of them, so a script
+	// stuck in a native call does not block it.
 	if (inEventDrivenMode) {
-		onScriptEvaluated();
-		resetScriptEngine();
+		QMetaObject::invokeMethod(this, "finishEventDrivenAbort", Qt::QueuedConnection);
+	}
+
+	QLOG_INFO() << "ScriptEngineWorker: reset requested, thread:" << QThread::currentThread();
+}
+
+void ScriptEngineWorker::forceStop()
+{
+	// Holding the lock until the end, so the abort can not complete and the next script can not start meanwhile.
+	QMutexLocker locker(&mAbortMutex);
+	if (mAbortStartTime == -1) {
+		return;
 	}
 
+	QLOG_ERROR() << "ScriptEngineWorker: script is not stopped"
+			<< (trikKernel::MonotonicClock::microseconds() - mAbortStartTime) / 1000
+			<< "ms after abort, forcing motors off";
+
+	mBrick.stop();
+	emit abortEvaluation();
+
+	QMutexLocker engineLocker(&mEngineMutex);
+	mEngine->abortEvaluation(QScriptValue("aborted"));
+}
+
+void ScriptEngineWorker::finishEventDrivenAbort()
+{
+	// Script may be evaluating again if it was aborted by brick.quit() from its global code, then run() finishes it.
+	if (mEngine->isEvaluating()) {
+		return;
+	}
+
+	{
+		QMutexLocker locker(&mAbortMutex);
+		if (mAbortStartTime == -1) {
+			return;
+		}
+	}
+
+	onScriptEvaluated();
+	resetScriptEngine();
+	onAbortCompleted();
+
 	QLOG_INFO() << "ScriptEngineWorker: reset complete, current script engine:" << mEngine
 			<< ", thread:" << QThread::currentThread();
 }
 
+void ScriptEngineWorker::onAbortCompleted()
+{
+	qint64 abortStartTime = -1;
+	{
+		QMutexLocker locker(&mAbortMutex);
+		abortStartTime = mAbortStartTime;
+		mAbortStartTime = -1;
+	}
+
+	if (abortStartTime != -1) {
+		int const latency = static_cast<int>((trikKernel::MonotonicClock::microseconds() - abortStartTime) / 1000);
+		QLOG_INFO() << "ScriptEngineWorker: script" << mScriptId << "aborted in" << latency << "ms";
+		emit aborted(latency);
+	}
+}
+
 ScriptEngineWorker &ScriptEngineWorker::clone()
 {
-	ScriptEngineWorker *result = new ScriptEngineWorker(mBrick, mStartDirPath);
+	ScriptEngineWorker *result = new ScriptEngineWorker(mBrick, mStartDirPath, mScriptCache);
 	result->setParent(this);
 	result->init();
 	QScriptValue globalObject = result->mEngine->globalObject();
@@ -119,7 +199,32 @@ void ScriptEngineWorker::init()
 	resetScriptEngine();
 }
 
-void ScriptEngineWorker::run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function)
+void ScriptEngineWorker::run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function
+		, qint64 requestTime)
+{
+	bool const needCallFunction = ScriptCache::needCallFunction(script, function);
+	evaluate(QScriptProgram(needCallFunction ? QString("%1\n%2();").arg(script, function) : script)
+			, script, inEventDrivenMode, scriptId, requestTime);
+}
+
+void ScriptEngineWorker::runFile(QString const &filePath, int scriptId, qint64 requestTime)
+{
+	ScriptCache::Entry const entry = mScriptCache.entry(filePath);
+	if (!entry.error.isEmpty()) {
+		// Script can not be evaluated, so there is no need to wait for evaluation to report an error.
+		qDebug() << "Can not run" << filePath << ":" << entry.error;
+		QLOG_ERROR() << "Can not run" << filePath << ":" << entry.error;
+		mScriptId = scriptId;
+		emit startedScript(mScriptId);
+		emit completed(entry.error, mScriptId);
+		return;
+	}
+
+	evaluate(entry.program, entry.script, false, scriptId, requestTime);
+}
+
+void ScriptEngineWorker::evaluate(QScriptProgram const &program, QString const &script, bool inEventDrivenMode
+		, int scriptId, qint64 requestTime)
 {
 	if (!mEngine) {
 		QLOG_FATAL() << "ScriptEngine is null on run";
@@ -137,16 +242,17 @@ void ScriptEngineWorker::run(QString const &script, bool inEventDrivenMode, int
 	}
 
 	mThreadingVariable.setCurrentScript(script);
-	QRegExp const functionRegexp(QString(
-			"(.*%1\\s*=\\s*\\w*\\s*function\\(.*\\).*)|(.*function\\s+%1\\s*\\(.*\\).*)").arg(function));
-	bool const needCallFunction = !function.isEmpty() && functionRegexp.exactMatch(script)
-			&& !script.trimmed().endsWith(function + "();");
-
 	mBrick.keys()->reset();
 
 	QLOG_INFO() << "ScriptEngineWorker: evaluating, script:" << mScriptId
 			<< ", thread:" << QThread::currentThread();
-	mEngine->evaluate(needCallFunction ? QString("%1\n%2();").arg(script, function) : script);
+
+	if (requestTime != -1) {
+		QLOG_INFO() << "ScriptEngineWorker: script" << mScriptId << "started"
+				<< trikKernel::MonotonicClock::microseconds() - requestTime << "us after run request";
+	}
+
+	mEngine->evaluate(program);
 	QLOG_INFO() << "ScriptEngineWorker: evaluation stopped, script:" << mScriptId
 			<< ", thread:" << QThread::currentThread();
 
@@ -159,9 +265,8 @@ void ScriptEngineWorker::run(QString const &script, bool inEventDrivenMode, int
 
 		onScriptEvaluated();
 		resetScriptEngine();
+		onAbortCompleted();
 	}
-
-	mEngineReset = true;
 }
 
 void ScriptEngineWorker::onScriptRequestingToQuit()
@@ -179,37 +284,87 @@ void ScriptEngineWorker::resetScriptEngine()
 {
 	QLOG_INFO() << "ScriptEngineWorker: resetting script engine" << mEngine
 			<< ", thread: " << QThread::currentThread();
-	if (mEngine) {
-		mEngine->deleteLater();
+
+	QScriptEngine *newEngine = nullptr;
+	{
+		QMutexLocker locker(&mStandbyEngineMutex);
+		newEngine = mStandbyEngine;
+		mStandbyEngine = nullptr;
+	}
+
+	if (!newEngine) {
+		newEngine = createScriptEngine();
+	}
+
+	QScriptEngine *oldEngine = nullptr;
+	{
+		// Other threads use mEngine only under this lock, so old engine is not used by anyone after it is replaced.
+		QMutexLocker locker(&mEngineMutex);
+		oldEngine = mEngine;
+		mEngine = newEngine;
+	}
+
+	if (oldEngine) {
+		oldEngine->deleteLater();
 	}
 
-	mEngine = new QScriptEngine();
 	QLOG_INFO() << "ScriptEngineWorker: new script engine" << mEngine << ", thread:" << QThread::currentThread();
 
-	qScriptRegisterMetaType(mEngine, batteryToScriptValue, batteryFromScriptValue);
-	qScriptRegisterMetaType(mEngine, displayToScriptValue, displayFromScriptValue);
-	qScriptRegisterMetaType(mEngine, encoderToScriptValue, encoderFromScriptValue);
-	qScriptRegisterMetaType(mEngine, gamepadToScriptValue, gamepadFromScriptValue);
-	qScriptRegisterMetaType(mEngine, keysToScriptValue, keysFromScriptValue);
-	qScriptRegisterMetaType(mEngine, ledToScriptValue, ledFromScriptValue);
-	qScriptRegisterMetaType(mEngine, mailboxToScriptValue, mailboxFromScriptValue);
-	qScriptRegisterMetaType(mEngine, motorToScriptValue, motorFromScriptValue);
-	qScriptRegisterMetaType(mEngine, sensorToScriptValue, sensorFromScriptValue);
-	qScriptRegisterMetaType(mEngine, sensor3dToScriptValue, sensor3dFromScriptValue);
-	qScriptRegisterMetaType(mEngine, lineSensorToScriptValue, lineSensorFromScriptValue);
-	qScriptRegisterMetaType(mEngine, colorSensorToScriptValue, colorSensorFromScriptValue);
-	qScriptRegisterMetaType(mEngine, objectSensorToScriptValue, objectSensorFromScriptValue);
-	qScriptRegisterMetaType(mEngine, timerToScriptValue, timerFromScriptValue);
-	qScriptRegisterSequenceMetaType<QVector<int>>(mEngine);
-
-	mEngine->globalObject().setProperty("brick", mEngine->newQObject(&mBrick));
-	mEngine->globalObject().setProperty("Threading", mEngine->newQObject(&mThreadingVariable));
+	if (!dynamic_cast<ScriptEngineWorker *>(parent())) {
+		// Workers of threads started by a script evaluate only once, so only main worker keeps a spare engine.
+		QMetaObject::invokeMethod(this, "prepareStandbyEngine", Qt::QueuedConnection);
+	}
+}
 
-	if (QFile::exists(mStartDirPath + "system.js")) {
-		mEngine->evaluate(trikKernel::FileUtils::readFromFile(mStartDirPath + "system.js"));
+void ScriptEngineWorker::prepareStandbyEngine()
+{
+	{
+		QMutexLocker locker(&mStandbyEngineMutex);
+		if (mStandbyEngine) {
+			return;
+		}
 	}
 
-	mEngine->setProcessEventsInterval(1);
+	qint64 const startTime = trikKernel::MonotonicClock::microseconds();
+	QScriptEngine * const engine = createScriptEngine();
+
+	// Standby engine is only created here, in worker thread, so no one could create it in the meantime.
+	QMutexLocker locker(&mStandbyEngineMutex);
+	mStandbyEngine = engine;
+	QLOG_INFO() << "ScriptEngineWorker: standby script engine" << mStandbyEngine << "prepared in"
+			<< trikKernel::MonotonicClock::microseconds() - startTime << "us";
+}
+
+QScriptEngine *ScriptEngineWorker::createScriptEngine()
+{
+	QScriptEngine * const engine = new QScriptEngine();
+
+	qScriptRegisterMetaType(engine, batteryToScriptValue, batteryFromScriptValue);
+	qScriptRegisterMetaType(engine, displayToScriptValue, displayFromScriptValue);
+	qScriptRegisterMetaType(engine, encoderToScriptValue, encoderFromScriptValue);
+	qScriptRegisterMetaType(engine, gamepadToScriptValue, gamepadFromScriptValue);
+	qScriptRegisterMetaType(engine, keysToScriptValue, keysFromScriptValue);
+	qScriptRegisterMetaType(engine, ledToScriptValue, ledFromScriptValue);
+	qScriptRegisterMetaType(engine, mailboxToScriptValue, mailboxFromScriptValue);
+	qScriptRegisterMetaType(engine, motorToScriptValue, motorFromScriptValue);
+	qScriptRegisterMetaType(engine, sensorToScriptValue, sensorFromScriptValue);
+	qScriptRegisterMetaType(engine, sensor3dToScriptValue, sensor3dFromScriptValue);
+	qScriptRegisterMetaType(engine, lineSensorToScriptValue, lineSensorFromScriptValue);
+	qScriptRegisterMetaType(engine, colorSensorToScriptValue, colorSensorFromScriptValue);
+	qScriptRegisterMetaType(engine, objectSensorToScriptValue, objectSensorFromScriptValue);
+	qScriptRegisterMetaType(engine, timerToScriptValue, timerFromScriptValue);
+	qScriptRegisterSequenceMetaType<QVector<int>>(engine);
+
+	engine->globalObject().setProperty("brick", engine->newQObject(&mBrick));
+	engine->globalObject().setProperty("Threading", engine->newQObject(&mThreadingVariable));
+
+	if (!mSystemScript.isEmpty()) {
+		engine->evaluate(mSystemScript);
+	}
+
+	engine->setProcessEventsInterval(1);
+
+	return engine;
 }
 
 void ScriptEngineWorker::onScriptEvaluated()
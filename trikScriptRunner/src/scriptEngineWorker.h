@@ -14,12 +14,14 @@
 
 #pragma once
 
+#include <QtCore/QMutex>
 #include <QtCore/QString>
 #include <QtCore/QThread>
 #include <QtScript/QScriptEngine>
 
 #include <trikControl/brick.h>
 
+#include "scriptCache.h"
 #include "threading.h"
 
 namespace trikScriptRunner
@@ -36,13 +38,21 @@ public:
 	/// Constructor.
 	/// @param brick - reference to trikControl::Brick instance.
 	/// @param startDirPath - path to the directory from which the application was executed.
-	ScriptEngineWorker(trikControl::Brick &brick, QString const &startDirPath);
+	/// @param scriptCache - cache of prepared script files, shared with script runner.
+	ScriptEngineWorker(trikControl::Brick &brick, QString const &startDirPath, ScriptCache &scriptCache);
+
+	~ScriptEngineWorker() override;
 
 	/// Copies this instance of ScriptEngineWorker and returns a new one. Script engine is copied deeply
 	/// i.e. the current state of the global scripting object is copied recursively.
 	/// Takes ownership via Qt parent-child system.
 	ScriptEngineWorker &clone();
 
+	/// Called when script did not stop in time after reset(). If it is still not stopped, powers off motors and
+	/// requests abort of evaluation again. Can be called from another thread. Abort can not complete while it works,
+	/// so it never stops a script started after the aborted one.
+	void forceStop();
+
 signals:
 	/// Emitted when current script execution is completed or is aborted by reset() call.
 	/// @param error - localized error message or empty string.
@@ -52,12 +62,17 @@ signals:
 	/// Emitted when evaluation is being interrupted. Used for stopping child threads when robot reset is requested.
 	void abortEvaluation();
 
+	/// Emitted when a script aborted by reset() actually stopped.
+	/// @param latency - time in milliseconds from reset() call to a moment when script stopped.
+	void aborted(int latency);
+
 public slots:
 	/// Initializes new QtScript engine.
 	void init();
 
 	/// Stops script execution and resets execution state (including script engine and trikControl itself). Can be
-	/// called from another thread.
+	/// called from another thread. Does not wait for a script to stop, completed() and aborted() signals are
+	/// emitted when it actually stops.
 	void reset();
 
 	/// Executes given script.
@@ -66,7 +81,16 @@ public slots:
 	///        when it is finished.
 	/// @param function - the name of the function execution must start with. If empty then the script will be
 	/// evaluated as-is, else function call will be appended to @arg script.
-	void run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function = "main");
+	/// @param requestTime - time when execution was requested (see trikKernel::MonotonicClock), used to log
+	///        latency of a start of a script, -1 if it is not known.
+	void run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function = "main"
+			, qint64 requestTime = -1);
+
+	/// Executes script from a given file, using a prepared script from a cache if file was not changed. Script is
+	/// started from "main" function, if it has one.
+	/// @param filePath - path to a script file.
+	/// @param requestTime - time when execution was requested, see run().
+	void runFile(QString const &filePath, int scriptId, qint64 requestTime = -1);
 
 	/// Plays "beep" sound.
 	void brickBeep();
@@ -78,19 +102,61 @@ private slots:
 	/// Abort script execution.
 	void onScriptRequestingToQuit();
 
-	/// Kill old script engine, create and reinit a new one.
+	/// Kill old script engine and replace it with a standby one, or create and init a new one if there is no
+	/// standby engine.
 	void resetScriptEngine();
 
+	/// Creates standby engine, so the next script does not wait for engine initialization. Called when worker
+	/// is idle after a script was finished.
+	void prepareStandbyEngine();
+
+	/// Completes abort of event-driven script, which is not evaluating and waits for events in worker thread.
+	void finishEventDrivenAbort();
+
 private:
+	/// Evaluates given program, common part of run() and runFile().
+	/// @param program - program to evaluate.
+	/// @param script - text of a script, used to start new threads.
+	void evaluate(QScriptProgram const &program, QString const &script, bool inEventDrivenMode, int scriptId
+			, qint64 requestTime);
+
+	/// Creates new script engine with brick, Threading and system.js functions available to scripts.
+	QScriptEngine *createScriptEngine();
+
 	void onScriptEvaluated();
 
+	/// Emits aborted() if a script was stopped by reset().
+	void onAbortCompleted();
+
 	// Has ownership. No smart pointers here because we need to do manual memory managment
 	// due to complicated mEngine lifecycle (see .cpp for more details).
 	QScriptEngine *mEngine;
+
+	/// Guards replacement of mEngine and its use from other threads by reset() and forceStop(). Worker thread is
+	/// the only one that replaces mEngine, so it uses mEngine without locking.
+	QMutex mEngineMutex;
+
+	/// Fully initialized engine that replaces mEngine when it is reset. Has ownership.
+	QScriptEngine *mStandbyEngine = nullptr;
+
+	/// Guards mStandbyEngine, since reset() can be called from another thread.
+	QMutex mStandbyEngineMutex;
+
 	trikControl::Brick &mBrick;
 	Threading mThreadingVariable;
 	QString const mStartDirPath;
-	bool mEngineReset;
+	ScriptCache &mScriptCache;
+
+	/// Contents of system.js, read once and evaluated in every new engine.
+	QString mSystemScript;
+
+	/// Time when reset() was called for a running script (see trikKernel::MonotonicClock), -1 if no abort is
+	/// in progress.
+	qint64 mAbortStartTime = -1;
+
+	/// Guards mAbortStartTime, since reset() and forceStop() can be called from another thread.
+	QMutex mAbortMutex;
+
 	int mScriptId;
 };
 
@@ -17,13 +17,16 @@
 #include <QtCore/QDebug>
 #include <QtCore/QFile>
 
+#include <trikKernel/monotonicClock.h>
+
 #include "scriptEngineWorker.h"
 
 using namespace trikScriptRunner;
 
-ScriptRunnerProxy::ScriptRunnerProxy(trikControl::Brick &brick, QString const &startDirPath)
+ScriptRunnerProxy::ScriptRunnerProxy(trikControl::Brick &brick, QString const &startDirPath
+		, ScriptCache &scriptCache)
 {
-	mEngineWorker = new ScriptEngineWorker(brick, startDirPath);
+	mEngineWorker = new ScriptEngineWorker(brick, startDirPath, scriptCache);
 	QMetaObject::invokeMethod(mEngineWorker, "init");
 
 	connect(&mWorkerThread, SIGNAL(finished()), mEngineWorker, SLOT(deleteLater()));
@@ -35,6 +38,13 @@ ScriptRunnerProxy::ScriptRunnerProxy(trikControl::Brick &brick, QString const &s
 
 	connect(mEngineWorker, SIGNAL(startedScript(int)), this, SIGNAL(startedScript(int)));
 
+	connect(mEngineWorker, SIGNAL(aborted(int)), this, SIGNAL(aborted(int)));
+	connect(mEngineWorker, SIGNAL(aborted(int)), &mAbortDeadlineTimer, SLOT(stop()));
+
+	mAbortDeadlineTimer.setSingleShot(true);
+	mAbortDeadlineTimer.setInterval(brick.abortDeadline());
+	connect(&mAbortDeadlineTimer, SIGNAL(timeout()), this, SLOT(onAbortDeadline()));
+
 	mWorkerThread.start();
 }
 
@@ -53,18 +63,42 @@ void ScriptRunnerProxy::brickBeep()
 
 void ScriptRunnerProxy::run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function)
 {
+	qint64 const requestTime = trikKernel::MonotonicClock::microseconds();
 	if (!inEventDrivenMode) {
-		mEngineWorker->reset();
+		reset();
 	}
 
 	QMetaObject::invokeMethod(mEngineWorker, "run"
 			, Q_ARG(QString const &, script)
 			, Q_ARG(bool, inEventDrivenMode)
 			, Q_ARG(int, scriptId)
-			, Q_ARG(QString const &, function));
+			, Q_ARG(QString const &, function)
+			, Q_ARG(qint64, requestTime));
+}
+
+void ScriptRunnerProxy::runFile(QString const &filePath, int scriptId)
+{
+	qint64 const requestTime = trikKernel::MonotonicClock::microseconds();
+	reset();
+
+	QMetaObject::invokeMethod(mEngineWorker, "runFile"
+			, Q_ARG(QString const &, filePath)
+			, Q_ARG(int, scriptId)
+			, Q_ARG(qint64, requestTime));
 }
 
 void ScriptRunnerProxy::reset()
 {
 	mEngineWorker->reset();
+	mAbortDeadlineTimer.start();
+}
+
+void ScriptRunnerProxy::setAbortDeadline(int milliseconds)
+{
+	mAbortDeadlineTimer.setInterval(milliseconds);
+}
+
+void ScriptRunnerProxy::onAbortDeadline()
+{
+	mEngineWorker->forceStop();
 }
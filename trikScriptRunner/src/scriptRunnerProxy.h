@@ -24,6 +24,7 @@
 
 namespace trikScriptRunner {
 
+class ScriptCache;
 class ScriptEngineWorker;
 
 /// Executes scripts in Qt Scripting Engine.
@@ -35,7 +36,8 @@ public:
 	/// Constructor.
 	/// @param brick - reference to trikControl::Brick instance.
 	/// @param startDirPath - path to the directory from which the application was executed.
-	ScriptRunnerProxy(trikControl::Brick &brick, QString const &startDirPath);
+	/// @param scriptCache - cache of prepared script files.
+	ScriptRunnerProxy(trikControl::Brick &brick, QString const &startDirPath, ScriptCache &scriptCache);
 
 	~ScriptRunnerProxy();
 
@@ -48,9 +50,18 @@ public:
 	///        evaluated as-is, else function call will be appended to @arg script.
 	void run(QString const &script, bool inEventDrivenMode, int scriptId, QString const &function = "main");
 
-	/// Aborts script execution.
+	/// Executes script from a given file asynchronously. If some script is already executing, it will be aborted.
+	/// @param filePath - path to a script file.
+	void runFile(QString const &filePath, int scriptId);
+
+	/// Aborts script execution. Does not wait for a script to stop. If it does not stop within abort deadline,
+	/// motors are powered off forcibly.
 	void reset();
 
+	/// Sets time after which motors are powered off if aborted script is still not stopped.
+	/// @param milliseconds - abort deadline in milliseconds.
+	void setAbortDeadline(int milliseconds);
+
 	/// Plays "beep" sound.
 	void brickBeep();
 
@@ -62,9 +73,20 @@ signals:
 
 	void startedScript(int scriptId);
 
+	/// Emitted when aborted script actually stopped.
+	/// @param latency - time in milliseconds from abort request to a moment when script stopped.
+	void aborted(int latency);
+
+private slots:
+	/// Forces script to stop if abort deadline passed.
+	void onAbortDeadline();
+
 private:
 	ScriptEngineWorker *mEngineWorker;  // Has ownership.
 	QThread mWorkerThread;
+
+	/// Single-shot timer started when abort is requested.
+	QTimer mAbortDeadlineTimer;
 };
 
 }
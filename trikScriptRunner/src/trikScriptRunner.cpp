@@ -14,8 +14,11 @@
 
 #include "include/trikScriptRunner/trikScriptRunner.h"
 
+#include <QtCore/QFileInfo>
+
 #include <trikKernel/fileUtils.h>
 
+#include "src/scriptCache.h"
 #include "src/scriptRunnerProxy.h"
 
 #include "QsLog.h"
@@ -26,7 +29,8 @@ using namespace trikScriptRunner;
 QString const constScriptsDirName = "scripts";
 
 TrikScriptRunner::TrikScriptRunner(trikControl::Brick &brick, QString const &startDirPath)
-	: mScriptRunnerProxy(new ScriptRunnerProxy(brick, startDirPath))
+	: mScriptCache(new ScriptCache())
+	, mScriptRunnerProxy(new ScriptRunnerProxy(brick, startDirPath, *mScriptCache))
 	, mStartDirPath(startDirPath)
 	, mMaxScriptId(0)
 {
@@ -35,6 +39,8 @@ TrikScriptRunner::TrikScriptRunner(trikControl::Brick &brick, QString const &sta
 
 	connect(mScriptRunnerProxy.data(), SIGNAL(startedScript(int))
 			, this, SLOT(onScriptStart(int)));
+
+	connect(mScriptRunnerProxy.data(), SIGNAL(aborted(int)), this, SIGNAL(aborted(int)));
 }
 
 TrikScriptRunner::~TrikScriptRunner()
@@ -52,6 +58,19 @@ QString TrikScriptRunner::scriptsDirName() const
 
 }
 
+void TrikScriptRunner::cacheScript(QString const &filePath)
+{
+	QString const suffix = QFileInfo(filePath).suffix();
+	if (suffix == "qts" || suffix == "js") {
+		mScriptCache->update(filePath);
+	}
+}
+
+void TrikScriptRunner::setAbortDeadline(int milliseconds)
+{
+	mScriptRunnerProxy->setAbortDeadline(milliseconds);
+}
+
 void TrikScriptRunner::brickBeep()
 {
 	mScriptRunnerProxy->brickBeep();
@@ -70,6 +89,13 @@ void TrikScriptRunner::run(QString const &script)
 	mScriptRunnerProxy->run(script, false, -1);
 }
 
+void TrikScriptRunner::runFile(QString const &filePath, QString const &fileName)
+{
+	QLOG_INFO() << "TrikScriptRunner: new script" << mMaxScriptId << "from file" << filePath;
+	mScriptRunnerProxy->runFile(filePath, mMaxScriptId);
+	mScriptFileNames[mMaxScriptId++] = fileName;
+}
+
 void TrikScriptRunner::runDirectCommand(QString const &command)
 {
 	QLOG_INFO() << "TrikScriptRunner: new direct command" << command;
@@ -16,6 +16,7 @@ include(../global.pri)
 
 HEADERS += \
 	$$PWD/include/trikScriptRunner/trikScriptRunner.h \
+	$$PWD/src/scriptCache.h \
 	$$PWD/src/scriptableParts.h \
 	$$PWD/src/scriptEngineWorker.h \
 	$$PWD/src/scriptRunnerProxy.h \
@@ -25,6 +26,7 @@ HEADERS += \
 SOURCES += \
 	$$PWD/src/scriptRunnerProxy.cpp \
 	$$PWD/src/scriptableParts.cpp \
+	$$PWD/src/scriptCache.cpp \
 	$$PWD/src/scriptEngineWorker.cpp \
 	$$PWD/src/trikScriptRunner.cpp \
 	$$PWD/src/threading.cpp \
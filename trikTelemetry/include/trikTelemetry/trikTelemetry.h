@@ -14,12 +14,15 @@
 
 #pragma once
 
+#include <QtCore/QScopedPointer>
+
 #include <trikKernel/trikServer.h>
 #include <trikControl/brick.h>
 
 namespace trikTelemetry {
 
 class Connection;
+class SensorsSnapshot;
 
 /// TrikTelemetry server provides an interface for getting information about ports configuration and sensors data
 /// of a brick.
@@ -34,11 +37,16 @@ public:
 	/// @param brick - a Brick used to respond to clients
 	TrikTelemetry(trikControl::Brick &brick);
 
+	~TrikTelemetry() override;
+
 private:
 	Connection *connectionFactory();
 
 	/// A Brick which is used by Connections to respond to clients' requests
 	trikControl::Brick &mBrick;
+
+	/// Sensor values shared by all connections.
+	QScopedPointer<SensorsSnapshot> mSnapshot;
 };
 
 }
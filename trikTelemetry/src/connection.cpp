@@ -16,10 +16,40 @@
 
 using namespace trikTelemetry;
 
-Connection::Connection(trikControl::Brick &brick)
+/// Kinds of binary sample frames.
+char const keyframe = 0x01;
+char const deltaFrame = 0x02;
+
+/// Number of delta frames between keyframes in binary mode.
+int const keyframeInterval = 100;
+
+/// Appends unsigned LEB128 varint.
+static void appendVarint(QByteArray &buffer, quint32 value)
+{
+	do {
+		char byte = static_cast<char>(value & 0x7f);
+		value >>= 7;
+		if (value != 0) {
+			byte |= 0x80;
+		}
+
+		buffer.append(byte);
+	} while (value != 0);
+}
+
+/// Appends signed value in zigzag encoding, so small negative values are short too.
+static void appendZigzag(QByteArray &buffer, int value)
+{
+	appendVarint(buffer, (static_cast<quint32>(value) << 1) ^ static_cast<quint32>(value >> 31));
+}
+
+Connection::Connection(trikControl::Brick &brick, SensorsSnapshot &snapshot)
 	: trikKernel::Connection(trikKernel::Protocol::messageLength)
 	, mBrick(brick)
+	, mSnapshot(snapshot)
+	, mPushTimer(this)
 {
+	connect(&mPushTimer, SIGNAL(timeout()), this, SLOT(pushUpdates()));
 }
 
 void Connection::processData(QByteArray const &data)
@@ -30,71 +60,99 @@ void Connection::processData(QByteArray const &data)
 	QString const dataRequested("data");
 	QString const singleSensorRequested("sensor:");
 	QString const buttonRequested("button:");
+	QString const mailboxRequested("mailbox");
+	QString const subscribeRequested("subscribe:");
+	QString const subscribeBinaryRequested("subscribeBinary:");
+	QString const schemaRequested("schema");
+	QString const unsubscribeRequested("unsubscribe");
+	QString const flightRecordRequested("flightRecord");
 	QString const accelerometerRequested("AccelerometerPort");
 	QString const gyroscopeRequested("GyroscopePort");
 
 	QString answer;
 
 	if (command.startsWith(dataRequested)) {
-		auto reportSensorReading = [this, &answer] (QString const &port) {
-			answer += QString("%1=%2:%3,")
-					.arg(port)
-					.arg(mBrick.sensor(port)->read())
-					.arg(mBrick.sensor(port)->readRawData());
-		};
-
-		answer = "data:";
-		answer += "analog:";
-		for (QString const &port : mBrick.sensorPorts(trikControl::Sensor::analogSensor)) {
-			reportSensorReading(port);
+		// All values are taken from one snapshot, so they are consistent and hardware is not read again.
+		QStringList const &ports = mSnapshot.allPorts();
+		QVector<SensorsSnapshot::Reading> const readings = mSnapshot.readings(ports);
+		QHash<QString, SensorsSnapshot::Reading> values;
+		for (int i = 0; i < ports.size(); ++i) {
+			values.insert(ports[i], readings[i]);
 		}
 
-		answer[answer.length() - 1] = ';';
-		answer += "digital:";
-		for (QString const &port : mBrick.sensorPorts(trikControl::Sensor::digitalSensor)) {
-			reportSensorReading(port);
-		}
+		auto reportReadings = [&answer, &values] (QString const &section, QStringList const &ports) {
+			answer += section;
+			for (QString const &port : ports) {
+				answer += QString("%1=%2:%3,")
+						.arg(port)
+						.arg(values[port].value.first())
+						.arg(values[port].rawValue);
+			}
 
-		answer[answer.length() - 1] = ';';
-		answer += "special:";
-		for (QString const &port : mBrick.sensorPorts(trikControl::Sensor::specialSensor)) {
-			reportSensorReading(port);
-		}
-
-		answer[answer.length() - 1] = ';';
-		answer += "encoders:";
-		for (QString const &port : mBrick.encoderPorts()) {
-			answer += QString("%1=%2:%3,")
-					.arg(port)
-					.arg(mBrick.encoder(port)->read())
-					.arg(mBrick.encoder(port)->readRawData());
-		}
+			answer[answer.length() - 1] = ';';
+		};
 
-		answer[answer.length() - 1] = ';';
-		answer += "accelerometer:" + serializeVector(mBrick.accelerometer()->read()) + ";";
-		answer += "gyroscope:" + serializeVector(mBrick.gyroscope()->read());
+		answer = "data:";
+		reportReadings("analog:", mSnapshot.sensorPorts(trikControl::Sensor::analogSensor));
+		reportReadings("digital:", mSnapshot.sensorPorts(trikControl::Sensor::digitalSensor));
+		reportReadings("special:", mSnapshot.sensorPorts(trikControl::Sensor::specialSensor));
+		reportReadings("encoders:", mSnapshot.encoderPorts());
+		answer += "accelerometer:" + serializeVector(values[accelerometerRequested].value) + ";";
+		answer += "gyroscope:" + serializeVector(values[gyroscopeRequested].value);
 	} else if (command.startsWith(portsRequested)) {
 		answer = "ports:";
-		answer += "analog:" + mBrick.sensorPorts(trikControl::Sensor::analogSensor).join(",") + ";";
-		answer += "digital:" + mBrick.sensorPorts(trikControl::Sensor::digitalSensor).join(",") + ";";
-		answer += "special:" + mBrick.sensorPorts(trikControl::Sensor::specialSensor).join(",") + ";";
-		answer += "encoders:" + mBrick.encoderPorts().join(",");
+		answer += "analog:" + mSnapshot.sensorPorts(trikControl::Sensor::analogSensor).join(",") + ";";
+		answer += "digital:" + mSnapshot.sensorPorts(trikControl::Sensor::digitalSensor).join(",") + ";";
+		answer += "special:" + mSnapshot.sensorPorts(trikControl::Sensor::specialSensor).join(",") + ";";
+		answer += "encoders:" + mSnapshot.encoderPorts().join(",");
+	} else if (command.startsWith(subscribeRequested)) {
+		answer = subscribe(command.mid(subscribeRequested.length()), false);
+	} else if (command.startsWith(subscribeBinaryRequested)) {
+		answer = subscribe(command.mid(subscribeBinaryRequested.length()), true);
+	} else if (command.startsWith(schemaRequested)) {
+		answer = schema(mSnapshot.allPorts());
+	} else if (command.startsWith(unsubscribeRequested)) {
+		mPushTimer.stop();
+		mSubscribedPorts.clear();
+		mLastSentValues.clear();
+		mClientValues.clear();
+		answer = "unsubscribed";
+	} else if (command.startsWith(flightRecordRequested)) {
+		// Record is binary, so it is sent as is instead of a text answer.
+		send("flightRecord:" + mBrick.flightRecord());
+		return;
+	} else if (command.startsWith(mailboxRequested)) {
+		answer = "mailbox:";
+		if (mBrick.mailbox() != nullptr) {
+			QVariantMap const peers = mBrick.mailbox()->peerStatistics();
+			for (auto peer = peers.constBegin(); peer != peers.constEnd(); ++peer) {
+				QVariantMap const statistics = peer.value().toMap();
+				answer += QString("%1=%2:%3:%4,")
+						.arg(peer.key())
+						.arg(statistics["averageRtt"].toLongLong())
+						.arg(statistics["minRtt"].toLongLong())
+						.arg(statistics["clockOffset"].toLongLong());
+			}
+
+			if (!peers.isEmpty()) {
+				answer.chop(1);
+			}
+		}
 	} else if (command.startsWith(singleSensorRequested)) {
 		answer = command + ":";
 		command.remove(0, singleSensorRequested.length());
-		if (command.startsWith(accelerometerRequested)) {
-			int const dimension = command.at(command.length() - 1).toLatin1() - 'X';
-			answer += QString::number(mBrick.accelerometer()->read()[dimension]);
-		} else if (command.startsWith(gyroscopeRequested)) {
+		if (command.startsWith(accelerometerRequested) || command.startsWith(gyroscopeRequested)) {
+			QString const port = command.startsWith(accelerometerRequested)
+					? accelerometerRequested
+					: gyroscopeRequested;
+
 			int const dimension = command.at(command.length() - 1).toLatin1() - 'X';
-			answer += QString::number(mBrick.gyroscope()->read()[dimension]);
-		} else if (mBrick.sensorPorts(trikControl::Sensor::analogSensor).contains(command)
-				|| mBrick.sensorPorts(trikControl::Sensor::digitalSensor).contains(command)
-				|| mBrick.sensorPorts(trikControl::Sensor::specialSensor).contains(command))
-		{
-			answer += QString::number(mBrick.sensor(command)->read());
-		} else if (mBrick.encoderPorts().contains(command)) {
-			answer += QString::number(mBrick.encoder(command)->read());
+			QVector<int> const value = mSnapshot.reading(port).value;
+			if (dimension >= 0 && dimension < value.size()) {
+				answer += QString::number(value[dimension]);
+			}
+		} else if (mSnapshot.contains(command)) {
+			answer += QString::number(mSnapshot.reading(command).value.first());
 		} else if (command.startsWith(buttonRequested)) {
 			command.remove(0, buttonRequested.length());
 			answer = "sensor:" + command + ":" + (isButtonPressed(command) ? "1" : "0");
@@ -104,6 +162,149 @@ void Connection::processData(QByteArray const &data)
 	send(answer.toUtf8());
 }
 
+QString Connection::subscribe(QString const &parameters, bool binary)
+{
+	QStringList const parts = parameters.split(':');
+	bool periodOk = false;
+	bool deadbandOk = false;
+	int const period = parts.size() == 3 ? parts[0].toInt(&periodOk) : 0;
+	int const deadband = parts.size() == 3 ? parts[1].toInt(&deadbandOk) : 0;
+	if (!periodOk || !deadbandOk || deadband < 0) {
+		return "error:malformed subscribe command";
+	}
+
+	QStringList ports;
+	if (parts[2].isEmpty()) {
+		ports = mSnapshot.allPorts();
+	} else {
+		for (QString const &port : parts[2].split(',')) {
+			if (!mSnapshot.contains(port)) {
+				return "error:unknown port " + port;
+			}
+
+			ports << port;
+		}
+	}
+
+	mSubscribedPorts = ports;
+	mDeadband = deadband;
+	mLastSentValues.clear();
+	mBinaryUpdates = binary;
+	mClientValues.clear();
+	mSequenceNumber = 0;
+	mPushTimer.start(qMax(static_cast<int>(SensorsSnapshot::minRefreshPeriodMs), period));
+
+	// Sending all values right away, client shall not wait for a period to get initial state.
+	QMetaObject::invokeMethod(this, "pushUpdates", Qt::QueuedConnection);
+
+	return binary ? schema(mSubscribedPorts) : "subscribed:" + mSubscribedPorts.join(",");
+}
+
+QString Connection::schema(QStringList const &ports) const
+{
+	QStringList components;
+	for (QString const &port : ports) {
+		SensorsSnapshot::PortKind const kind = mSnapshot.kind(port);
+		bool const isVector = kind == SensorsSnapshot::PortKind::accelerometer
+				|| kind == SensorsSnapshot::PortKind::gyroscope;
+
+		components << QString("%1=%2").arg(port).arg(isVector ? 3 : 1);
+	}
+
+	return "schema:" + components.join(",");
+}
+
+void Connection::pushBinaryUpdate(QVector<SensorsSnapshot::Reading> const &readings)
+{
+	QVector<int> values;
+	for (SensorsSnapshot::Reading const &reading : readings) {
+		// Padding or cutting vectors to 3 components, so frame layout always matches schema.
+		int const components = reading.value.size() == 1 ? 1 : 3;
+		for (int i = 0; i < components; ++i) {
+			values.append(i < reading.value.size() ? reading.value[i] : 0);
+		}
+	}
+
+	QByteArray frame;
+	frame.reserve(1 + 5 + values.size() * 5);
+
+	if (mClientValues.size() != values.size() || mFramesSinceKeyframe >= keyframeInterval) {
+		frame.append(keyframe);
+		appendVarint(frame, mSequenceNumber);
+		for (int const value : values) {
+			appendZigzag(frame, value);
+		}
+
+		mClientValues = values;
+		mFramesSinceKeyframe = 0;
+	} else {
+		frame.append(deltaFrame);
+		appendVarint(frame, mSequenceNumber);
+		bool changed = false;
+		for (int i = 0; i < values.size(); ++i) {
+			int delta = values[i] - mClientValues[i];
+			if (qAbs(delta) <= mDeadband) {
+				// Change is accumulated until it exceeds deadband.
+				delta = 0;
+			} else {
+				mClientValues[i] = values[i];
+				changed = true;
+			}
+
+			appendZigzag(frame, delta);
+		}
+
+		if (!changed) {
+			return;
+		}
+
+		++mFramesSinceKeyframe;
+	}
+
+	++mSequenceNumber;
+	send(frame);
+}
+
+void Connection::pushUpdates()
+{
+	if (mSubscribedPorts.isEmpty()) {
+		return;
+	}
+
+	QVector<SensorsSnapshot::Reading> const readings = mSnapshot.readings(mSubscribedPorts);
+	if (mBinaryUpdates) {
+		pushBinaryUpdate(readings);
+		return;
+	}
+
+	QString update;
+	for (int i = 0; i < mSubscribedPorts.size(); ++i) {
+		QString const &port = mSubscribedPorts[i];
+		QVector<int> const &value = readings[i].value;
+		auto const lastSent = mLastSentValues.constFind(port);
+		bool changed = lastSent == mLastSentValues.constEnd() || lastSent.value().size() != value.size();
+		for (int j = 0; !changed && j < value.size(); ++j) {
+			changed = qAbs(value[j] - lastSent.value()[j]) > mDeadband;
+		}
+
+		if (changed) {
+			mLastSentValues.insert(port, value);
+			SensorsSnapshot::PortKind const kind = mSnapshot.kind(port);
+			bool const isVector = kind == SensorsSnapshot::PortKind::accelerometer
+					|| kind == SensorsSnapshot::PortKind::gyroscope;
+
+			update += QString("%1=%2,")
+					.arg(port)
+					.arg(isVector ? serializeVector(value) : QString::number(value.first()));
+		}
+	}
+
+	if (!update.isEmpty()) {
+		update.chop(1);
+		send(("update:" + update).toUtf8());
+	}
+}
+
 QString Connection::serializeVector(QVector<int> const &vector) {
 	QString result = "(";
 	for (int coord : vector) {
@@ -14,9 +14,16 @@
 
 #pragma once
 
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
 #include <trikKernel/connection.h>
 #include <trikControl/brick.h>
 
+#include "sensorsSnapshot.h"
+
 namespace trikTelemetry {
 
 /// Connection class accepts requests for sensors configuration and current sensor values. Uses a brick
@@ -25,6 +32,25 @@ namespace trikTelemetry {
 /// Accepted commands:
 ///     data - sends data from sensors to a client
 ///     ports - sends current ports configuration to a client
+///     mailbox - sends average and minimal round-trip time and clock offset (in microseconds) for every robot known
+///               to a mailbox, as "mailbox:<hull number>=<average rtt>:<min rtt>:<clock offset>,..."
+///     subscribe:<period in ms>:<deadband>:<port>,<port>,... - starts pushing values of given ports (all sensor and
+///               encoder ports, accelerometer and gyroscope if port list is empty) every period as
+///               "update:<port>=<value>,...". Only values that changed by more than deadband since they were last
+///               sent are included, nothing is sent if no value changed. Accelerometer and gyroscope values are
+///               sent as "(x,y,z)".
+///     subscribeBinary:<period in ms>:<deadband>:<port>,<port>,... - same as "subscribe", but answers with
+///               schema (see "schema" command) of subscribed ports and pushes binary sample frames instead of text
+///               updates. Frame is "<kind byte><varint sequence number><zigzag varint value>..." with one value per
+///               component of every port in schema order. Kind 0x01 is a keyframe with absolute values, kind 0x02 is
+///               a delta frame with differences from values in previous frames (changes within deadband are sent
+///               as 0 and accumulated). Keyframe is sent first and then periodically. Frames start with a control
+///               byte, so they are easily told from text answers.
+///     schema - sends "schema:<port>=<number of components>,..." for all ports.
+///     unsubscribe - stops pushing values.
+///     flightRecord - sends "flightRecord:" followed by binary contents of on-board flight recorder (history of
+///               sensor readings and motor powers, see trikControl FlightRecorder for format), nothing follows
+///               the prefix if recorder is disabled.
 class Connection : public trikKernel::Connection
 {
 	Q_OBJECT
@@ -32,16 +58,59 @@ class Connection : public trikKernel::Connection
 public:
 	/// Constructor.
 	/// @param brick - a Brick used to respond to clients.
-	explicit Connection(trikControl::Brick &brick);
+	/// @param snapshot - sensor values shared by all connections.
+	Connection(trikControl::Brick &brick, SensorsSnapshot &snapshot);
 
 private:
 	void processData(QByteArray const &data) override;
 
 	static QString serializeVector(QVector<int> const &vector);
 
+	/// Parses "subscribe" or "subscribeBinary" command and starts pushing updates. Returns answer to a client.
+	QString subscribe(QString const &parameters, bool binary);
+
+	/// Returns schema of given ports, "schema:<port>=<number of components>,...".
+	QString schema(QStringList const &ports) const;
+
+	/// Sends subscribed values in a binary frame.
+	void pushBinaryUpdate(QVector<SensorsSnapshot::Reading> const &readings);
+
+private slots:
+	/// Reads subscribed ports and sends values that changed beyond deadband.
+	void pushUpdates();
+
+private:
+
 	bool isButtonPressed(QString const &buttonName);
 
 	trikControl::Brick &mBrick;
+
+	/// Source of sensor values, shared with other connections, so hardware is not read by each of them.
+	SensorsSnapshot &mSnapshot;
+
+	/// Fires when it is time to push updates to a subscribed client.
+	QTimer mPushTimer;
+
+	/// Ports a client is subscribed to.
+	QStringList mSubscribedPorts;
+
+	/// Minimal change of a value that is sent to a client.
+	int mDeadband = 0;
+
+	/// Values of subscribed ports that were last sent to a client.
+	QHash<QString, QVector<int>> mLastSentValues;
+
+	/// True if updates are sent as binary frames.
+	bool mBinaryUpdates = false;
+
+	/// Values of all components of subscribed ports known to a client in binary mode, in schema order.
+	QVector<int> mClientValues;
+
+	/// Sequence number of the next binary frame.
+	quint32 mSequenceNumber = 0;
+
+	/// Number of delta frames sent since last keyframe.
+	int mFramesSinceKeyframe = 0;
 };
 
 }
@@ -0,0 +1,136 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "sensorsSnapshot.h"
+
+#include <trikKernel/monotonicClock.h>
+
+using namespace trikTelemetry;
+
+/// Reading is reused if it is younger than minimal refresh period minus this tolerance, so a client polling exactly
+/// with minimal period gets a fresh reading each time despite timer jitter.
+qint64 const refreshToleranceMs = 2;
+
+SensorsSnapshot::SensorsSnapshot(trikControl::Brick &brick)
+	: mBrick(brick)
+{
+	auto addPort = [this](QString const &port, PortKind kind) {
+		mPortIndexes.insert(port, mKinds.size());
+		mKinds.append(kind);
+		mAllPorts.append(port);
+	};
+
+	for (trikControl::Sensor::Type const type : {trikControl::Sensor::analogSensor
+			, trikControl::Sensor::digitalSensor
+			, trikControl::Sensor::specialSensor})
+	{
+		QStringList const ports = mBrick.sensorPorts(type);
+		mSensorPorts.insert(type, ports);
+		for (QString const &port : ports) {
+			addPort(port, PortKind::sensor);
+		}
+	}
+
+	mEncoderPorts = mBrick.encoderPorts();
+	for (QString const &port : mEncoderPorts) {
+		addPort(port, PortKind::encoder);
+	}
+
+	addPort("AccelerometerPort", PortKind::accelerometer);
+	addPort("GyroscopePort", PortKind::gyroscope);
+
+	mReadings.resize(mKinds.size());
+	mRefreshTimes.fill(-1, mKinds.size());
+}
+
+QStringList const &SensorsSnapshot::sensorPorts(trikControl::Sensor::Type type) const
+{
+	return *mSensorPorts.find(type);
+}
+
+QStringList const &SensorsSnapshot::encoderPorts() const
+{
+	return mEncoderPorts;
+}
+
+QStringList const &SensorsSnapshot::allPorts() const
+{
+	return mAllPorts;
+}
+
+bool SensorsSnapshot::contains(QString const &port) const
+{
+	return mPortIndexes.contains(port);
+}
+
+SensorsSnapshot::PortKind SensorsSnapshot::kind(QString const &port) const
+{
+	return mKinds[mPortIndexes.value(port)];
+}
+
+SensorsSnapshot::Reading SensorsSnapshot::reading(QString const &port)
+{
+	return readings({port}).first();
+}
+
+QVector<SensorsSnapshot::Reading> SensorsSnapshot::readings(QStringList const &ports)
+{
+	QVector<Reading> result;
+	result.reserve(ports.size());
+
+	QMutexLocker locker(&mMutex);
+	qint64 const now = trikKernel::MonotonicClock::milliseconds();
+	for (QString const &port : ports) {
+		int const index = mPortIndexes.value(port);
+		refreshIfStale(index, now);
+		result.append(mReadings[index]);
+	}
+
+	return result;
+}
+
+void SensorsSnapshot::refreshIfStale(int portIndex, qint64 now)
+{
+	qint64 const refreshTime = mRefreshTimes[portIndex];
+	if (refreshTime != -1 && now - refreshTime < minRefreshPeriodMs - refreshToleranceMs) {
+		return;
+	}
+
+	// Sensors and encoders are read once, scaled value is computed from a raw one.
+	QString const &port = mAllPorts[portIndex];
+	Reading &reading = mReadings[portIndex];
+	switch (mKinds[portIndex]) {
+	case PortKind::sensor: {
+		trikControl::Sensor * const sensor = mBrick.sensor(port);
+		reading.rawValue = sensor->readRawData();
+		reading.value = QVector<int>(1, sensor->valueFromRaw(reading.rawValue));
+		break;
+	}
+	case PortKind::encoder: {
+		trikControl::Encoder * const encoder = mBrick.encoder(port);
+		reading.rawValue = encoder->readRawData();
+		reading.value = QVector<int>(1, encoder->valueFromRaw(reading.rawValue));
+		break;
+	}
+	case PortKind::accelerometer:
+		reading.value = mBrick.accelerometer()->read();
+		break;
+	case PortKind::gyroscope:
+		reading.value = mBrick.gyroscope()->read();
+		break;
+	}
+
+	// Time of a request, not of a read, so ports read later in the same request do not look fresher than others.
+	mRefreshTimes[portIndex] = now;
+}
@@ -0,0 +1,107 @@
+/* Copyright 2014 CyberTech Labs Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <trikControl/brick.h>
+
+namespace trikTelemetry {
+
+/// Values of all sensors, encoders, accelerometer and gyroscope of a brick, shared by all telemetry connections.
+/// Each port is read from hardware lazily, when some connection asks for it and its last reading is older than
+/// minimal refresh period, so every port is polled no more often than once per period regardless of the number of
+/// clients, and ports nobody asks for are not polled at all. Thread-safe.
+class SensorsSnapshot
+{
+public:
+	/// Kind of a port, determines how it is read.
+	enum class PortKind {
+		sensor
+		, encoder
+		, accelerometer
+		, gyroscope
+	};
+
+	/// Reading of one port.
+	struct Reading {
+		/// Value of a sensor or an encoder, or values of accelerometer or gyroscope axes.
+		QVector<int> value;
+
+		/// Raw value of a sensor or an encoder, 0 for accelerometer and gyroscope.
+		int rawValue = 0;
+	};
+
+	/// Minimal period of reading a port from hardware in milliseconds. Readings are shared by clients during this
+	/// period, so clients shall not ask for values more often.
+	static int const minRefreshPeriodMs = 10;
+
+	/// Constructor. Port lists are taken from a brick once, so brick shall be already configured.
+	explicit SensorsSnapshot(trikControl::Brick &brick);
+
+	/// Returns ports of sensors of given type.
+	QStringList const &sensorPorts(trikControl::Sensor::Type type) const;
+
+	/// Returns encoder ports.
+	QStringList const &encoderPorts() const;
+
+	/// Returns all ports, including "AccelerometerPort" and "GyroscopePort".
+	QStringList const &allPorts() const;
+
+	/// Returns true if there is a port with given name.
+	bool contains(QString const &port) const;
+
+	/// Returns kind of given port, port shall exist.
+	PortKind kind(QString const &port) const;
+
+	/// Returns current reading of given port, reading it from hardware if last reading is too old. Port shall exist.
+	Reading reading(QString const &port);
+
+	/// Returns current readings of given ports, reading from hardware only those of them whose last readings are too
+	/// old. Ports shall exist.
+	QVector<Reading> readings(QStringList const &ports);
+
+private:
+	/// Reads port with given index from hardware if its last reading is too old. Shall be called with mMutex locked.
+	/// @param now - current time in milliseconds on trikKernel::MonotonicClock.
+	void refreshIfStale(int portIndex, qint64 now);
+
+	trikControl::Brick &mBrick;
+
+	QHash<int, QStringList> mSensorPorts;
+	QStringList mEncoderPorts;
+	QStringList mAllPorts;
+
+	/// Maps port name to its index in mAllPorts, mKinds and mReadings.
+	QHash<QString, int> mPortIndexes;
+
+	/// Kinds of ports by port index.
+	QVector<PortKind> mKinds;
+
+	/// Last readings by port index.
+	QVector<Reading> mReadings;
+
+	/// Times of the last hardware reads by port index in milliseconds on trikKernel::MonotonicClock, -1 if port was
+	/// not read yet.
+	QVector<qint64> mRefreshTimes;
+
+	/// Guards readings and refresh times.
+	QMutex mMutex;
+};
+
+}
@@ -15,16 +15,22 @@
 #include "trikTelemetry.h"
 
 #include "src/connection.h"
+#include "src/sensorsSnapshot.h"
 
 using namespace trikTelemetry;
 
 TrikTelemetry::TrikTelemetry(trikControl::Brick &brick)
 	: trikKernel::TrikServer([this] () { return connectionFactory(); })
 	, mBrick(brick)
+	, mSnapshot(new SensorsSnapshot(brick))
+{
+}
+
+TrikTelemetry::~TrikTelemetry()
 {
 }
 
 Connection * TrikTelemetry::connectionFactory()
 {
-	return new Connection(mBrick);
+	return new Connection(mBrick, *mSnapshot);
 }
@@ -3,10 +3,12 @@ include(../global.pri)
 HEADERS += \
 	$$PWD/include/trikTelemetry/trikTelemetry.h \
 	$$PWD/src/connection.h \
+	$$PWD/src/sensorsSnapshot.h \
 
 SOURCES += \
 	$$PWD/src/trikTelemetry.cpp \
 	$$PWD/src/connection.cpp \
+	$$PWD/src/sensorsSnapshot.cpp \
 
 TEMPLATE = lib
 